@@ -20,6 +20,26 @@ int main(int argc, char *argv[])
 
     Chip8 chip8;
     std::string gamePath(argv[1]);
+
+    // Optional parameters select the opcode decoder and record an input movie
+    std::string recordPath;
+    for (int i = 2; i < argc; i++)
+    {
+        const std::string argument(argv[i]);
+        if (argument == "--record" && i + 1 < argc)
+        {
+            recordPath = argv[++i];
+            continue;
+        }
+
+        Decoder decoder;
+        if (!parseDecoder(argument, decoder))
+        {
+            return EXIT_FAILURE;
+        }
+        chip8.setDecoder(decoder);
+    }
+
     if (!chip8.loadGame(gamePath))
     {
         std::cout << "Error: Couldn't load game file" << std::endl;
@@ -32,6 +52,11 @@ int main(int argc, char *argv[])
         std::cout << "Error: UserInterface initialization failed" << std::endl;
         return EXIT_FAILURE;
     }
+
+    if (!recordPath.empty())
+    {
+        userInterface.startRecording(recordPath);
+    }
     userInterface.run();
 
     return EXIT_SUCCESS;
@@ -0,0 +1,77 @@
+//--------------------------------------------------------------------------------------------------
+// Cross-Platform Chip-8 Emulator
+// Copyright (C) 2020 Enrico Schörnick
+// Licensed under the MIT License
+//--------------------------------------------------------------------------------------------------
+
+#ifndef CHIP8_AOT_HPP
+#define CHIP8_AOT_HPP
+
+#include <array>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+
+struct Chip8State;
+
+/**
+ * Runtime interface for games which were translated to C++ by chip8_aot.
+ * The generated translation units register themselves at startup and get
+ * picked up by Chip8 (Aot decoder) whenever a game with the same content
+ * gets loaded.
+ */
+
+// Gives generated code access to the interpreter for complex instructions
+struct AotContext
+{
+    void *chip8;
+    void (*execute)(void *chip8, uint16_t opcode);
+};
+
+// Compiled block: executes its instructions and returns the next instruction pointer
+using AotFunction = uint16_t (*)(Chip8State &state, const AotContext &context);
+
+struct AotBlock
+{
+    uint16_t start;
+    uint16_t end; // First byte after the block
+    uint8_t length;
+    AotFunction function;
+};
+
+struct AotModule
+{
+    const char *name;
+    const uint8_t *rom;
+    size_t romSize;
+    const AotBlock *blocks;
+    size_t blockCount;
+};
+
+// Generated code creates one static registrar per compiled game
+struct AotRegistrar
+{
+    explicit AotRegistrar(const AotModule &module);
+};
+
+/**
+ * Compiled blocks of the currently loaded game. Blocks which contain bytes
+ * written by the game itself get disabled and run in the interpreter again.
+ */
+class AotProgram
+{
+public:
+    explicit AotProgram(const AotModule &module);
+
+    static const AotModule *find(const uint8_t *rom, size_t size);
+
+    const AotBlock *getBlock(uint16_t address) const;
+    void invalidate(uint16_t address, uint16_t length);
+
+private:
+    const AotModule &module;
+    std::array<const AotBlock *, 4096> blocks{};
+    std::bitset<4096> code;
+};
+
+#endif
@@ -0,0 +1,119 @@
+//--------------------------------------------------------------------------------------------------
+// Cross-Platform Chip-8 Emulator
+// Copyright (C) 2020 Enrico Schörnick
+// Licensed under the MIT License
+//--------------------------------------------------------------------------------------------------
+
+#ifndef CHIP8_BATCHRUNNER_HPP
+#define CHIP8_BATCHRUNNER_HPP
+
+#include "Chip8.hpp"
+#include "LockstepEngine.hpp"
+
+#include <array>
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// Keypad state (bit n = key n pressed) which is applied from the given frame on
+struct BatchInput
+{
+    uint64_t frame;
+    uint16_t keys;
+};
+
+// One emulator run: a game with its settings
+struct BatchJob
+{
+    std::string gamePath;
+    Decoder decoder{Decoder::Cached};
+    uint64_t frames{600};
+    int instructionsPerSecond{0}; // 0 uses the best speed of the game
+    std::vector<BatchInput> inputs; // Sorted by frame
+    uint32_t seed{1}; // Random number generator (CXNN), applied after the start state
+    std::shared_ptr<const MachineState> startState; // Replaces the state after loading the game
+};
+
+struct BatchResult
+{
+    bool loaded{false};
+    int worker{-1};
+    uint64_t instructions{0};
+    double seconds{0.0};
+
+    // Display after the last frame and hash chain over the display of every frame
+    uint64_t displayHash{0};
+    uint64_t framesHash{0};
+
+    // Final registers
+    std::array<uint8_t, 16> V{};
+    uint16_t I{0};
+    uint16_t instructionPointer{0};
+    uint8_t stackPointer{0};
+    uint8_t delayTimer{0};
+    uint8_t soundTimer{0};
+};
+
+struct WorkerStats
+{
+    uint64_t jobs{0};
+    uint64_t steals{0};
+    uint64_t instructions{0};
+    double seconds{0.0};
+};
+
+/**
+ * Runs independent emulator jobs on all cores. Every worker owns a deque of
+ * jobs and takes work from its back, idle workers steal from the front of
+ * the other deques. Each worker reuses one Chip8 instance per decoder and
+ * writes its results into the slot of the job, so the only shared state is
+ * the deque of the worker which gets robbed.
+ *
+ * In lockstep mode jobs with the same game, start state, speed and length get packed into
+ * groups of LockstepEngine::kLanes which run together in one LockstepEngine,
+ * the decoder of these jobs is ignored.
+ */
+class BatchRunner
+{
+public:
+    explicit BatchRunner(unsigned threads = 0);
+
+    void setLockstep(bool enabled);
+    std::vector<BatchResult> run(const std::vector<BatchJob> &jobs);
+
+    unsigned getThreads() const;
+    const std::vector<WorkerStats> &getStats() const;
+
+private:
+    static constexpr size_t kDecoders{static_cast<size_t>(Decoder::Aot) + 1};
+
+    struct alignas(64) Worker
+    {
+        std::mutex mutex;
+        std::deque<size_t> queue;
+        std::array<std::unique_ptr<Chip8>, kDecoders> pool; // One instance per decoder
+        std::unique_ptr<LockstepEngine> lockstep;
+        WorkerStats stats;
+    };
+
+    unsigned threads;
+    bool lockstep{false};
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<WorkerStats> stats;
+
+    // Units of work, a single job or the jobs of one lockstep engine
+    std::vector<std::vector<size_t>> packs;
+
+    void createPacks(const std::vector<BatchJob> &jobs);
+    void work(unsigned index, const std::vector<BatchJob> &jobs, std::vector<BatchResult> &results);
+    bool takePack(unsigned index, size_t &pack);
+    Chip8 &getInstance(Worker &worker, Decoder decoder);
+    static void runJob(Chip8 &chip8, const BatchJob &job, BatchResult &result);
+    void runLockstep(Worker &worker, const std::vector<BatchJob> &jobs, const std::vector<size_t> &pack,
+                     std::vector<BatchResult> &results);
+};
+
+#endif
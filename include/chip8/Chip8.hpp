@@ -8,17 +8,31 @@
 #define CHIP8_CHIP8_HPP
 
 #include "Game.hpp"
+#include "Aot.hpp"
+#include "Opcode.hpp"
+#include "ControlFlowGraph.hpp"
+#include "JitCompiler.hpp"
 
 #include <array>
+#include <bitset>
 #include <vector>
 #include <chrono>
 #include <string>
 #include <memory>
 #include <cstdint>
+#include <type_traits>
 
-struct Chip8State
+class InputQueue;
+class InputMovie;
+class Profiler;
+
+/**
+ * Everything which defines the emulated machine. The struct is trivially
+ * copyable, so snapshots are a single memcpy and save states store it as is.
+ */
+struct alignas(64) MachineState
 {
-    const uint16_t kStartAddress{0x200};
+    static constexpr uint16_t kStartAddress{0x200};
     static constexpr uint8_t kVerticalRes{32};
     static constexpr uint8_t kHorizontalRes{64};
 
@@ -34,17 +48,67 @@ struct Chip8State
     std::array<bool, 16> keypad{};
     std::array<uint16_t, 16> stack{};
     std::array<uint8_t, 4096> memory{};
-    std::array<bool, kHorizontalRes * kVerticalRes> display{};
 
+    // One bit per pixel, the most significant bit of a row is the leftmost pixel
+    std::array<uint64_t, kVerticalRes> display{};
+
+    uint16_t instructionsPerSecond{500};
+
+    // Instructions executed since the game got loaded, input movies are timed with it
+    uint64_t instructionCount{0};
+
+    // State of the xorshift generator behind CXNN, never zero
+    uint32_t random{1};
+
+    // Set while FX0A waits for a key press, the instruction pointer stays on it until then
+    bool waitingForKey{false};
+    uint8_t keyRegister{0};
+
+    bool getPixel(int x, int y) const
+    {
+        return (display[y] >> (kHorizontalRes - 1 - x)) & 0x1;
+    }
+
+    // Registers which index memory, the stack or V are in range
+    bool isValid() const;
+
+    // FNV-1a hash of the display, identical displays have identical hashes
+    uint64_t getDisplayHash(uint64_t hash = 0xCBF29CE484222325) const;
+};
+
+static_assert(std::is_trivially_copyable_v<MachineState>, "MachineState must be copyable with memcpy");
+
+struct Chip8State : MachineState
+{
     // Current game
     std::unique_ptr<Game> game;
 
+    // Emulation control and debugging, not part of snapshots
     bool isRunning{false};
-    uint16_t instructionsPerSecond{500};
     std::vector<uint16_t> breakpoints;
-    std::vector<std::string> disassembly;
+
+    // Code, data and subroutines of the game, rebuilt whenever a load changes its bytes
+    std::shared_ptr<const ControlFlowGraph> controlFlow;
+};
+
+// Available backends for the decode step of the emulation
+enum class Decoder
+{
+    Switch,   // Nested switch statements on the opcode nibbles
+    Table,    // Flat lookup table from every 16 bit opcode to its handler
+    Cached,   // Micro-ops predecoded at load time, no decoding at all
+    Threaded, // Predecoded micro-ops executed by the threaded interpreter core
+    Jit,      // Hot basic blocks compiled to x86-64 code, cold code stays cached
+    Aot       // Blocks compiled ahead of time by chip8_aot, everything else cached
 };
 
+// Conversion between decoders and their command line names, unknown names get reported as error
+bool parseDecoder(const std::string &name, Decoder &decoder);
+const char *getDecoderName(Decoder decoder);
+
+// Command line games of the tools, directories get expanded to the sorted .ch8 files in them
+std::vector<std::string> findGames(const std::vector<std::string> &paths);
+
 class Chip8
 {
 public:
@@ -52,7 +116,10 @@ public:
     void start();
     void stop();
     void catchUp();
-    int executeMs(int ms);
+    // Runs frames as fast as possible for the given time, the timers tick every emulated frame
+    uint64_t executeMs(int ms);
+    uint64_t execute(uint64_t count);
+    uint64_t runFrame();
     void emulateCycle();
     bool loadGame(const std::string &gamePath);
     void setButton(bool pressed, int index);
@@ -61,12 +128,67 @@ public:
     void decreaseSpeed();
     void toggleBreakpoint();
 
+    // Snapshots of the machine state, in memory and as save state files
+    void saveState(MachineState &snapshot) const;
+    void loadState(const MachineState &snapshot);
+    bool saveStateFile(const std::string &path) const;
+    bool loadStateFile(const std::string &path);
+    void setDecoder(Decoder decoder);
+    Decoder getDecoder() const;
+
+    // Seed of the random number generator, used from the next game load on and for the current game
+    void setSeed(uint32_t seed);
+
+    // Key changes from another thread, execution stops at the instruction each one is stamped with
+    void setInputQueue(InputQueue *queue);
+    void applyInput();
+
+    // Records every key change and timer tick, nullptr stops recording
+    void setMovie(InputMovie *movie);
+
+#ifdef CHIP8_PROFILE
+    // Counts and times every instruction while set, nullptr stops profiling
+    void setProfiler(Profiler *profiler);
+#endif
+
 private:
+    using Handler = void (Chip8::*)(const MicroOp &op);
+
     Chip8State state{};
     uint16_t opcode{0};
+    Decoder decoder{Decoder::Switch};
+    uint32_t seed{1};
+    InputQueue *inputQueue{nullptr};
+    InputMovie *movie{nullptr};
+#ifdef CHIP8_PROFILE
+    Profiler *profiler{nullptr};
+#endif
+    static const std::array<Handler, kOpcodeCount> handlers;
+    static const std::array<Opcode, 0x10000> opcodeTable;
+
+    // Predecoded instruction for every memory address (odd ones included)
+    std::array<MicroOp, 4096> instructionCache{};
+
+    // Superinstruction starting at every memory address (cached decoder only)
+    std::array<Fusion, 4096> fusions{};
+    static const int kMaxLoadRun{8};
+
+    // Dynamic recompiler, only created if the Jit decoder gets selected
+    std::unique_ptr<JitCompiler> jit{};
+
+    // Ahead of time compiled blocks of the current game (Aot decoder only)
+    std::unique_ptr<AotProgram> aot{};
+
+    // Every address of short loops which only wait for the timers or keys, verified before each skip
+    std::bitset<4096> idleLoops{};
+    static const int kMaxIdleLoopLength{8};
+
     const uint8_t kMinSpeed{100};
     const uint8_t kSpeedStepSize{100};
+    static const int kFramesPerSecond{60};
+    static const uint64_t kClockCheckInterval{4096};
     uint64_t instructionsExecuted{0};
+    uint64_t frameRemainder{0};
     std::chrono::time_point<std::chrono::steady_clock> startTime{};
     const uint8_t fontset[80] = {
         0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
@@ -89,44 +211,69 @@ private:
 
     void initialize();
     void resetTime();
-    void disassembleInstructions();
-    std::string disassemble(uint16_t address);
+    uint64_t runBatch(uint64_t count);
+    uint64_t skipIdleLoop(uint64_t count);
+    void findIdleLoops();
+    void analyzeControlFlow();
+    void executeInstruction();
+#ifdef CHIP8_PROFILE
+    uint64_t runProfiled(uint64_t count);
+#endif
+    void flushInput();
+    uint32_t nextRandom();
+    uint64_t runThreaded(uint64_t count);
+    uint64_t runJit(uint64_t count);
+    static void jitHelper(void *context, uint64_t op);
+    uint64_t runAot(uint64_t count);
+    void loadAotProgram();
+    static void aotHelper(void *context, uint16_t opcode);
+    void dispatchSwitch();
+    void dispatchTable();
+    void predecodeInstructions();
+    MicroOp fetchMicroOp(uint16_t address);
+    void invalidateInstructions(uint16_t address, uint16_t length);
+    void fuseInstructions();
+    Fusion findFusion(uint16_t address) const;
+    uint64_t runCached(uint64_t count);
+    int executeFusion(const Fusion &fusion);
+    static std::array<Opcode, 0x10000> buildOpcodeTable();
     
     // Opcode methodes
-    void CPU_00E0();
-    void CPU_00EE();
-    void CPU_1NNN();
-    void CPU_2NNN();
-    void CPU_3XNN();
-    void CPU_4XNN();
-    void CPU_5XY0();
-    void CPU_6XNN();
-    void CPU_7XNN();
-    void CPU_8XY0();
-    void CPU_8XY1();
-    void CPU_8XY2();
-    void CPU_8XY3();
-    void CPU_8XY4();
-    void CPU_8XY5();
-    void CPU_8XY6();
-    void CPU_8XY7();
-    void CPU_8XYE();
-    void CPU_9XY0();
-    void CPU_ANNN();
-    void CPU_BNNN();
-    void CPU_CXNN();
-    void CPU_DXYN();
-    void CPU_EX9E();
-    void CPU_EXA1();
-    void CPU_FX07();
-    void CPU_FX0A();
-    void CPU_FX15();
-    void CPU_FX18();
-    void CPU_FX1E();
-    void CPU_FX29();
-    void CPU_FX33();
-    void CPU_FX55();
-    void CPU_FX65();
+    void CPU_INVALID(const MicroOp &op);
+    void CPU_00E0(const MicroOp &op);
+    void CPU_00EE(const MicroOp &op);
+    void CPU_1NNN(const MicroOp &op);
+    void CPU_2NNN(const MicroOp &op);
+    void CPU_3XNN(const MicroOp &op);
+    void CPU_4XNN(const MicroOp &op);
+    void CPU_5XY0(const MicroOp &op);
+    void CPU_6XNN(const MicroOp &op);
+    void CPU_7XNN(const MicroOp &op);
+    void CPU_8XY0(const MicroOp &op);
+    void CPU_8XY1(const MicroOp &op);
+    void CPU_8XY2(const MicroOp &op);
+    void CPU_8XY3(const MicroOp &op);
+    void CPU_8XY4(const MicroOp &op);
+    void CPU_8XY5(const MicroOp &op);
+    void CPU_8XY6(const MicroOp &op);
+    void CPU_8XY7(const MicroOp &op);
+    void CPU_8XYE(const MicroOp &op);
+    void CPU_9XY0(const MicroOp &op);
+    void CPU_ANNN(const MicroOp &op);
+    void CPU_BNNN(const MicroOp &op);
+    void CPU_CXNN(const MicroOp &op);
+    void CPU_DXYN(const MicroOp &op);
+    void CPU_EX9E(const MicroOp &op);
+    void CPU_EXA1(const MicroOp &op);
+    void CPU_FX07(const MicroOp &op);
+    void CPU_FX0A(const MicroOp &op);
+    void CPU_FX15(const MicroOp &op);
+    void CPU_FX18(const MicroOp &op);
+    void CPU_FX1E(const MicroOp &op);
+    void CPU_FX29(const MicroOp &op);
+    void CPU_FX33(const MicroOp &op);
+    void CPU_FX55(const MicroOp &op);
+    void CPU_FX65(const MicroOp &op);
 };
 
 #endif
\ No newline at end of file
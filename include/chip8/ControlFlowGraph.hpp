@@ -0,0 +1,104 @@
+//--------------------------------------------------------------------------------------------------
+// Cross-Platform Chip-8 Emulator
+// Copyright (C) 2020 Enrico Schörnick
+// Licensed under the MIT License
+//--------------------------------------------------------------------------------------------------
+
+#ifndef CHIP8_CONTROLFLOWGRAPH_HPP
+#define CHIP8_CONTROLFLOWGRAPH_HPP
+
+#include "Disassembler.hpp"
+
+#include <array>
+#include <bitset>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// Basic block: instructions which always run from start to end
+struct BasicBlock
+{
+    uint16_t start;
+    uint16_t end;                     // Address behind the last instruction
+    uint16_t function;                // Entry of the subroutine the block belongs to
+    std::vector<uint16_t> successors; // Start of every block which can run next
+    uint16_t callee{0};               // Subroutine called by the last instruction, 0 if there is none
+};
+
+struct CodeIssue
+{
+    enum Type
+    {
+        InvalidOpcode,    // Unknown opcode, ignored by the emulator
+        TargetOutOfRange, // Jump or call to an address outside of the game
+        RunsOffEnd,       // Execution continues behind the last byte of the game
+        IndirectJump      // BNNN, its targets depend on V0 and aren't followed
+    };
+
+    Type type;
+    uint16_t address;
+
+    // Indirect jumps are common in working games, everything else is a bug
+    bool isError() const
+    {
+        return type != IndirectJump;
+    }
+};
+
+/**
+ * Static control flow graph of a game. Code is found by following every path
+ * from the start address through jumps, calls and skips, everything of the
+ * game which isn't reached this way is data (sprites). Calls are assumed to
+ * return, BNNN jumps end their path. Paths also end at targets outside of
+ * the game, which get reported as issues just like invalid opcodes (those
+ * are ignored by the emulator, so paths continue behind them).
+ */
+class ControlFlowGraph
+{
+public:
+    void build(const std::array<uint8_t, 4096> &memory, uint16_t start, uint16_t end);
+
+    const std::vector<BasicBlock> &getBlocks() const;
+    const std::vector<uint16_t> &getFunctions() const;
+    const std::vector<CodeIssue> &getIssues() const;
+
+    // True if any path executes an instruction which covers the byte
+    bool isCode(uint16_t address) const;
+    size_t getCodeSize() const;
+
+    // True if any path executes an instruction which starts at the address
+    bool isInstruction(uint16_t address) const;
+
+    // True for the start address and every target of a call
+    bool isFunction(uint16_t address) const;
+
+    // How a disassembly shows the line at the address, Byte lines are followed by a line at address + 1
+    Disassembler::Role getRole(uint16_t address) const;
+
+    // Block which contains an instruction starting at the address, nullptr if none does
+    const BasicBlock *findBlock(uint16_t address) const;
+
+    // Graphviz graph with one cluster per subroutine and the disassembly in every block
+    bool saveDot(const std::string &path, const std::string &name) const;
+
+    static const char *getIssueName(CodeIssue::Type type);
+
+private:
+    std::array<uint8_t, 4096> memory{};
+    uint16_t start{0};
+    uint16_t end{0};
+    std::vector<BasicBlock> blocks;
+    std::vector<uint16_t> functions;
+    std::vector<CodeIssue> issues;
+    std::bitset<4096> instructions; // Reachable instruction starts
+    std::bitset<4096> leaders;      // Instructions which start a block
+    std::bitset<4096> code;         // Bytes covered by reachable instructions
+
+    uint16_t getOpcode(uint16_t address) const;
+    bool isInGame(uint16_t address) const;
+    void findInstructions();
+    void createBlocks();
+    void assignFunctions();
+};
+
+#endif
@@ -0,0 +1,54 @@
+//--------------------------------------------------------------------------------------------------
+// Cross-Platform Chip-8 Emulator
+// Copyright (C) 2020 Enrico Schörnick
+// Licensed under the MIT License
+//--------------------------------------------------------------------------------------------------
+
+#ifndef CHIP8_DISASSEMBLER_HPP
+#define CHIP8_DISASSEMBLER_HPP
+
+#include "Opcode.hpp"
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <string_view>
+
+/**
+ * Table driven disassembler which never allocates. Lines get written with
+ * std::to_chars into caller buffers or into the arena of a Disassembler,
+ * which holds one line slot per memory address. Lines are only decoded when
+ * they are asked for and decoded again when the opcode at their address
+ * changed, so a view only pays for the lines it shows.
+ */
+class Disassembler
+{
+public:
+    // Longest line is "fff - DRW   Vf   Vf   #f", slots are rounded up
+    static constexpr size_t kLineSize{32};
+
+    // What the bytes of a line are, usually decided by the control flow graph of the game
+    enum class Role : uint8_t
+    {
+        Code,       // Instruction, "fff - CLS"
+        Subroutine, // First instruction of a subroutine, "fff : CLS"
+        Data,       // Two bytes no path executes (sprites), "fff - DB    #3c   #7e"
+        Byte        // One byte of data in front of a misaligned instruction, "fff - DB    #3c"
+    };
+
+    // Writes the line of an instruction into buffer (kLineSize bytes at least), returns its length
+    static size_t format(char *buffer, uint16_t address, uint16_t opcode, Role role = Role::Code);
+
+    // Line of the instruction at an address, stays valid until the line gets decoded again
+    std::string_view getLine(const std::array<uint8_t, 4096> &memory, uint16_t address, Role role = Role::Code);
+
+    void clear();
+
+private:
+    std::array<char, 4096 * kLineSize> arena{};
+    std::array<uint16_t, 4096> opcodes{};
+    std::array<Role, 4096> roles{};
+    std::array<uint8_t, 4096> lengths{}; // 0 = not decoded yet
+};
+
+#endif
@@ -0,0 +1,138 @@
+//--------------------------------------------------------------------------------------------------
+// Cross-Platform Chip-8 Emulator
+// Copyright (C) 2020 Enrico Schörnick
+// Licensed under the MIT License
+//--------------------------------------------------------------------------------------------------
+
+#ifndef CHIP8_EMULATIONTHREAD_HPP
+#define CHIP8_EMULATIONTHREAD_HPP
+
+#include "Chip8.hpp"
+#include "SeqLock.hpp"
+#include "InputQueue.hpp"
+#include "InputMovie.hpp"
+#include "TripleBuffer.hpp"
+#include "FrameScheduler.hpp"
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include <functional>
+
+// Registers, stack and status, published after every batch of instructions
+struct Registers
+{
+    uint16_t I;
+    uint8_t delayTimer;
+    uint8_t soundTimer;
+    uint8_t stackPointer;
+    std::array<uint8_t, 16> V;
+    uint16_t instructionPointer;
+    std::array<uint16_t, 16> stack;
+    std::array<bool, 16> keypad;
+    uint16_t instructionsPerSecond;
+    uint64_t instructionCount;
+    bool isRunning;
+    bool waitingForKey;
+    std::chrono::steady_clock::time_point time; // When the registers got published
+};
+
+// Throughput of the emulation, measured once per second
+struct EmulationStats
+{
+    uint64_t instructions;          // Executed since the emulation thread started
+    uint64_t instructionsPerSecond; // Executed within the last second
+    double speed;                   // Emulated time per wall-clock time, 1.0 at normal speed
+};
+
+/**
+ * Runs the Chip8 on its own thread, so rendering never delays emulation.
+ * The thread runs one emulated 60Hz frame per deadline of its scheduler, in
+ * warp mode the frames run back to back and the clock only gets read every
+ * few thousand instructions.
+ * Completed frames are published through a triple buffer and the registers
+ * through a seqlock, the user interface reads both without blocking the
+ * emulation. Keys go through a lock-free queue, stamped with the instruction
+ * which the emulation reaches at the time of the key event. Everything else
+ * (control, loading) gets posted as a command which the emulation thread
+ * runs between two batches. The Chip8 must not be used by any other thread
+ * while the emulation thread runs.
+ */
+class EmulationThread
+{
+public:
+    using Command = std::function<void(Chip8 &chip8)>;
+
+    explicit EmulationThread(Chip8 &chip8);
+    ~EmulationThread();
+
+    // EmulationThread owns its thread -- no copy/move operators
+    EmulationThread(const EmulationThread &) = delete;
+    EmulationThread &operator=(const EmulationThread &) = delete;
+    EmulationThread(EmulationThread &&) = delete;
+    EmulationThread &operator=(EmulationThread &&) = delete;
+
+    void start();
+    void stop();
+
+    // Commands which change the game or the breakpoints have to say so
+    void post(Command command, bool changesDebugInfo = false);
+    void setWarpMode(bool enabled);
+    void setMovie(InputMovie *movie);
+
+    // Fails if the emulation is too far behind to take more keys
+    bool pushInput(bool pressed, int key);
+
+    // Newest frame, stays valid until the next call of getView()
+    const MachineState &getFrame() const;
+
+    // Updates the view with the newest frame and registers, returns true if there was a new frame
+    bool getView(Chip8State &view);
+
+    EmulationStats getStats() const;
+
+private:
+    // Warp mode publishes a frame after every slice, so the view still gets about 60 per second
+    static constexpr int kWarpSliceMs{1000 / FrameScheduler::kFramesPerSecond};
+
+    Chip8 &chip8;
+    std::thread thread;
+    std::atomic<bool> quit{false};
+    FrameScheduler scheduler;
+    bool warpMode{false};
+    uint64_t instructions{0};
+    uint64_t reportInstructions{0};
+    std::chrono::steady_clock::time_point reportTime{};
+    InputQueue inputQueue;
+
+    std::mutex commandMutex;
+    std::vector<std::pair<Command, bool>> commands;
+    std::vector<std::pair<Command, bool>> pendingCommands;
+
+    TripleBuffer<MachineState> frames;
+    SeqLock<Registers> registers;
+    SeqLock<EmulationStats> stats;
+
+    // Rarely changing data, guarded by a mutex and versioned so the view only copies it after changes
+    std::mutex debugMutex;
+    std::atomic<uint64_t> debugVersion{0};
+    uint64_t viewDebugVersion{0};
+    std::unique_ptr<Game> game;
+    std::vector<uint16_t> breakpoints;
+    std::shared_ptr<const ControlFlowGraph> controlFlow;
+
+    void run();
+    void runCommands();
+    void publishFrame();
+    void publishRegisters();
+    void publishDebugInfo();
+    void publishStats();
+};
+
+#endif
@@ -0,0 +1,40 @@
+//--------------------------------------------------------------------------------------------------
+// Cross-Platform Chip-8 Emulator
+// Copyright (C) 2020 Enrico Schörnick
+// Licensed under the MIT License
+//--------------------------------------------------------------------------------------------------
+
+#ifndef CHIP8_FRAMESCHEDULER_HPP
+#define CHIP8_FRAMESCHEDULER_HPP
+
+#include <chrono>
+#include <cstdint>
+
+/**
+ * Paces emulated 60Hz frames against the monotonic clock. Deadlines are
+ * absolute and computed from the first frame, so sleeping late never adds
+ * up to a drift. Falling behind by more than a few frames (debugger, system
+ * suspend) restarts the pacing instead of running the missed frames at once.
+ */
+class FrameScheduler
+{
+public:
+    static constexpr uint64_t kFramesPerSecond{60};
+
+    // The next frame starts right away
+    void reset();
+
+    // Sleeps until the deadline of the next frame
+    void waitForNextFrame();
+
+private:
+    static constexpr uint64_t kMaxLag{6};
+
+    std::chrono::steady_clock::time_point start{std::chrono::steady_clock::now()};
+    uint64_t frame{0};
+
+    std::chrono::steady_clock::time_point getDeadline(uint64_t frame) const;
+    static void sleepUntil(std::chrono::steady_clock::time_point deadline);
+};
+
+#endif
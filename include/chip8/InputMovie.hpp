@@ -0,0 +1,82 @@
+//--------------------------------------------------------------------------------------------------
+// Cross-Platform Chip-8 Emulator
+// Copyright (C) 2020 Enrico Schörnick
+// Licensed under the MIT License
+//--------------------------------------------------------------------------------------------------
+
+#ifndef CHIP8_INPUTMOVIE_HPP
+#define CHIP8_INPUTMOVIE_HPP
+
+#include "Chip8.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+/**
+ * Input movie: the state a recording started from and everything which
+ * changed the machine from outside afterwards, timer ticks and keys. Events
+ * are timed with the instruction count of the machine, so a replay applies
+ * them between the same instructions as the recording. As the random number
+ * generator is part of the state, the replay matches the recording exactly.
+ *
+ * File layout: a 64 byte header, the start state and the events, all of
+ * them as they are laid out in memory.
+ */
+struct MovieEvent
+{
+    enum Type : uint8_t
+    {
+        Frame,   // Timer tick
+        Press,   // Key pressed
+        Release, // Key released
+    };
+
+    uint64_t instruction; // Instruction count of the machine when the event happened
+    uint32_t frame;       // Timer ticks since the recording started
+    uint8_t type;
+    uint8_t key;
+};
+
+struct MovieHeader
+{
+    static constexpr char kMagic[8]{'C', 'H', 'I', 'P', '8', 'M', 'O', 'V'};
+    static constexpr uint32_t kVersion{1};
+    static constexpr uint16_t kByteOrder{0x0102};
+
+    char magic[8];
+    uint32_t version;
+    uint32_t stateVersion; // Version of the save states with the same MachineState
+    uint64_t eventCount;
+    uint16_t byteOrder;
+    char game[38]; // Name of the game, for information only
+};
+
+static_assert(sizeof(MovieHeader) == 64, "MachineState has to start at an aligned offset");
+
+class InputMovie
+{
+public:
+    void startRecording(const MachineState &state, const std::string &game);
+    void recordButton(const MachineState &state, bool pressed, int key);
+    void recordFrame(const MachineState &state);
+
+    bool save(const std::string &path) const;
+    bool load(const std::string &path);
+
+    // Runs the whole movie, the game has to be loaded already
+    bool replay(Chip8 &chip8) const;
+
+    const MachineState &getStartState() const;
+    const std::vector<MovieEvent> &getEvents() const;
+    std::string getGame() const;
+
+private:
+    std::unique_ptr<MachineState> startState;
+    std::string game;
+    std::vector<MovieEvent> events;
+    uint32_t frames{0};
+};
+
+#endif
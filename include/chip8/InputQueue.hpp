@@ -0,0 +1,85 @@
+//--------------------------------------------------------------------------------------------------
+// Cross-Platform Chip-8 Emulator
+// Copyright (C) 2020 Enrico Schörnick
+// Licensed under the MIT License
+//--------------------------------------------------------------------------------------------------
+
+#ifndef CHIP8_INPUTQUEUE_HPP
+#define CHIP8_INPUTQUEUE_HPP
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Key change which takes effect right before the given instruction gets executed
+struct InputEvent
+{
+    uint64_t instruction; // Instruction count of the machine
+    uint8_t key;
+    bool pressed;
+};
+
+/**
+ * Lock-free queue of key changes for one producer (user interface) and one
+ * consumer (emulation) thread. Both sides cache the index of the other one,
+ * so the shared cache lines are only touched if the cached index says the
+ * queue is full or empty.
+ */
+class InputQueue
+{
+public:
+    static constexpr size_t kCapacity{256};
+
+    // Producer side, fails if the queue is full
+    bool push(const InputEvent &event)
+    {
+        const auto tail = this->tail.load(std::memory_order_relaxed);
+        if (tail - cachedHead == kCapacity)
+        {
+            cachedHead = head.load(std::memory_order_acquire);
+            if (tail - cachedHead == kCapacity)
+            {
+                return false;
+            }
+        }
+
+        events[tail % kCapacity] = event;
+        this->tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side, the oldest event or nullptr if the queue is empty
+    const InputEvent *front()
+    {
+        const auto head = this->head.load(std::memory_order_relaxed);
+        if (head == cachedTail)
+        {
+            cachedTail = tail.load(std::memory_order_acquire);
+            if (head == cachedTail)
+            {
+                return nullptr;
+            }
+        }
+
+        return &events[head % kCapacity];
+    }
+
+    void pop()
+    {
+        head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+private:
+    std::array<InputEvent, kCapacity> events{};
+
+    // Consumer cache line
+    alignas(64) std::atomic<uint64_t> head{0};
+    uint64_t cachedTail{0};
+
+    // Producer cache line
+    alignas(64) std::atomic<uint64_t> tail{0};
+    uint64_t cachedHead{0};
+};
+
+#endif
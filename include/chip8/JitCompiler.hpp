@@ -0,0 +1,79 @@
+//--------------------------------------------------------------------------------------------------
+// Cross-Platform Chip-8 Emulator
+// Copyright (C) 2020 Enrico Schörnick
+// Licensed under the MIT License
+//--------------------------------------------------------------------------------------------------
+
+#ifndef CHIP8_JITCOMPILER_HPP
+#define CHIP8_JITCOMPILER_HPP
+
+#include "Opcode.hpp"
+
+#include <array>
+#include <bitset>
+#include <vector>
+#include <cstdint>
+
+struct Chip8State;
+
+/**
+ * Dynamic recompiler which translates hot Chip-8 basic blocks into x86-64 code.
+ * Blocks end at jumps, calls, returns and skips, in front of breakpoints and
+ * after instructions which write to memory. Everything which can't be
+ * translated (or isn't hot yet) stays with the interpreter.
+ */
+class JitCompiler
+{
+public:
+    // Compiled block: executes its instructions and returns the next instruction pointer
+    using Block = uint16_t (*)(Chip8State *state, void *context);
+
+    // Called by compiled code for instructions which aren't translated natively
+    using Helper = void (*)(void *context, uint64_t op);
+
+    JitCompiler(Helper helper, void *context);
+    ~JitCompiler();
+
+    // JitCompiler owns executable memory -- no copy/move operators
+    JitCompiler(const JitCompiler &) = delete;
+    JitCompiler &operator=(const JitCompiler &) = delete;
+    JitCompiler(JitCompiler &&) = delete;
+    JitCompiler &operator=(JitCompiler &&) = delete;
+
+    static bool isSupported();
+
+    Block getBlock(uint16_t address) const;
+    uint8_t getBlockLength(uint16_t address) const;
+    bool recordExecution(uint16_t address);
+    Block compile(const Chip8State &state, uint16_t address);
+    void invalidate(uint16_t address, uint16_t length);
+    void flush();
+    void reset();
+
+private:
+    struct BlockInfo
+    {
+        uint16_t start;
+        uint16_t end; // First byte after the block
+    };
+
+    static const int kHotThreshold{32};
+    static const int kMaxBlockLength{32};
+    static const size_t kCodeSize{1024 * 1024};
+
+    Helper helper;
+    void *context;
+    uint8_t *code{nullptr};
+    size_t codeUsed{0};
+
+    std::array<Block, 4096> blocks{};
+    std::array<uint8_t, 4096> blockLength{};
+    std::array<uint8_t, 4096> heat{};
+    std::bitset<4096> uncompilable;
+    std::bitset<4096> selfModified;
+    std::vector<BlockInfo> blockInfos;
+
+    Block install(const std::vector<uint8_t> &bytes);
+};
+
+#endif
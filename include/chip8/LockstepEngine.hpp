@@ -0,0 +1,78 @@
+//--------------------------------------------------------------------------------------------------
+// Cross-Platform Chip-8 Emulator
+// Copyright (C) 2020 Enrico Schörnick
+// Licensed under the MIT License
+//--------------------------------------------------------------------------------------------------
+
+#ifndef CHIP8_LOCKSTEPENGINE_HPP
+#define CHIP8_LOCKSTEPENGINE_HPP
+
+#include "Opcode.hpp"
+
+#include <array>
+#include <cstdint>
+
+struct MachineState;
+
+/**
+ * Runs kLanes instances of the same game in lockstep. All registers, the
+ * memory and the display are stored as structure of arrays with one vector
+ * lane per instance, so one decoded instruction gets executed for every lane
+ * at once. Lanes which diverge (different keys, random numbers) are masked
+ * out: every step executes the lanes with the lowest instruction pointer and
+ * the others wait until they get together again. Every lane executes exactly
+ * the instructions a single Chip8 instance would execute.
+ */
+class LockstepEngine
+{
+public:
+    static constexpr int kLanes{16};
+
+    LockstepEngine();
+
+    // Copies one state into every lane or one lane back into a state
+    void loadState(const MachineState &state);
+    void storeState(int lane, MachineState &state) const;
+
+    void setKeys(int lane, uint16_t keys);
+    void setSeed(int lane, uint32_t seed);
+
+    uint64_t execute(uint64_t count);
+    void updateTimers();
+
+    uint64_t getDisplayHash(int lane, uint64_t hash = 0xCBF29CE484222325) const;
+    uint64_t getSteps() const;
+
+private:
+    // 0xFF for every lane which takes part in the current step
+    using Mask = std::array<uint8_t, kLanes>;
+
+    template <typename T>
+    using Lanes = std::array<T, kLanes>;
+
+    // Structure of arrays, the lane is always the last index
+    alignas(64) std::array<Lanes<uint8_t>, 16> V{};
+    alignas(64) std::array<Lanes<uint8_t>, 4096> memory{};
+    alignas(64) std::array<Lanes<uint64_t>, 32> display{};
+    alignas(64) std::array<Lanes<uint16_t>, 16> stack{};
+    alignas(64) Lanes<uint16_t> I{};
+    alignas(64) Lanes<uint16_t> instructionPointer{};
+    alignas(64) Lanes<uint8_t> delayTimer{};
+    alignas(64) Lanes<uint8_t> soundTimer{};
+    alignas(64) Lanes<uint8_t> stackPointer{};
+    alignas(64) Lanes<uint16_t> keypad{};
+    alignas(64) Lanes<uint32_t> random{};
+
+    // Lanes parked on FX0A skip their budget until a key gets pressed
+    alignas(64) Lanes<uint8_t> waitingForKey{};
+    alignas(64) Lanes<uint8_t> keyRegister{};
+    alignas(64) Lanes<uint64_t> instructionCount{};
+    uint64_t steps{0};
+
+    uint64_t executeChunk(uint16_t count);
+    int selectLanes(Lanes<uint16_t> &remaining, Mask &mask, uint16_t &opcode);
+    void executeLanes(const MicroOp &op, const Mask &mask);
+    void drawSprite(int lane, const MicroOp &op);
+};
+
+#endif
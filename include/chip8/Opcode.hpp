@@ -0,0 +1,178 @@
+//--------------------------------------------------------------------------------------------------
+// Cross-Platform Chip-8 Emulator
+// Copyright (C) 2020 Enrico Schörnick
+// Licensed under the MIT License
+//--------------------------------------------------------------------------------------------------
+
+#ifndef CHIP8_OPCODE_HPP
+#define CHIP8_OPCODE_HPP
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * All instruction classes of the Chip-8. The values are used as indices into
+ * handler tables, so Invalid has to stay the first entry.
+ */
+enum class Opcode : uint8_t
+{
+    Invalid,
+    CPU_00E0,
+    CPU_00EE,
+    CPU_1NNN,
+    CPU_2NNN,
+    CPU_3XNN,
+    CPU_4XNN,
+    CPU_5XY0,
+    CPU_6XNN,
+    CPU_7XNN,
+    CPU_8XY0,
+    CPU_8XY1,
+    CPU_8XY2,
+    CPU_8XY3,
+    CPU_8XY4,
+    CPU_8XY5,
+    CPU_8XY6,
+    CPU_8XY7,
+    CPU_8XYE,
+    CPU_9XY0,
+    CPU_ANNN,
+    CPU_BNNN,
+    CPU_CXNN,
+    CPU_DXYN,
+    CPU_EX9E,
+    CPU_EXA1,
+    CPU_FX07,
+    CPU_FX0A,
+    CPU_FX15,
+    CPU_FX18,
+    CPU_FX1E,
+    CPU_FX29,
+    CPU_FX33,
+    CPU_FX55,
+    CPU_FX65
+};
+
+// Number of entries in the Opcode enum
+constexpr size_t kOpcodeCount{static_cast<size_t>(Opcode::CPU_FX65) + 1};
+
+// Names of the instruction classes, indexed by the Opcode enum
+constexpr std::array<const char *, kOpcodeCount> kOpcodeNames{
+    "INVALID",
+    "00E0", "00EE", "1NNN", "2NNN", "3XNN", "4XNN", "5XY0", "6XNN",
+    "7XNN", "8XY0", "8XY1", "8XY2", "8XY3", "8XY4", "8XY5", "8XY6",
+    "8XY7", "8XYE", "9XY0", "ANNN", "BNNN", "CXNN", "DXYN", "EX9E",
+    "EXA1", "FX07", "FX0A", "FX15", "FX18", "FX1E", "FX29", "FX33",
+    "FX55", "FX65"};
+
+/**
+ * Determine the instruction class of a raw opcode.
+ * Follows exactly the same rules as the switch decoder in Chip8::emulateCycle().
+ */
+constexpr Opcode decodeOpcode(uint16_t opcode)
+{
+    switch (opcode & 0xF000) {
+    case 0x0000:
+        switch (opcode & 0x000F) {
+        case 0x0000: return Opcode::CPU_00E0;
+        case 0x000E: return Opcode::CPU_00EE;
+        } break;
+    case 0x1000: return Opcode::CPU_1NNN;
+    case 0x2000: return Opcode::CPU_2NNN;
+    case 0x3000: return Opcode::CPU_3XNN;
+    case 0x4000: return Opcode::CPU_4XNN;
+    case 0x5000: return Opcode::CPU_5XY0;
+    case 0x6000: return Opcode::CPU_6XNN;
+    case 0x7000: return Opcode::CPU_7XNN;
+    case 0x8000:
+        switch (opcode & 0x000F) {
+        case 0x0000: return Opcode::CPU_8XY0;
+        case 0x0001: return Opcode::CPU_8XY1;
+        case 0x0002: return Opcode::CPU_8XY2;
+        case 0x0003: return Opcode::CPU_8XY3;
+        case 0x0004: return Opcode::CPU_8XY4;
+        case 0x0005: return Opcode::CPU_8XY5;
+        case 0x0006: return Opcode::CPU_8XY6;
+        case 0x0007: return Opcode::CPU_8XY7;
+        case 0x000E: return Opcode::CPU_8XYE;
+        } break;
+    case 0x9000: return Opcode::CPU_9XY0;
+    case 0xA000: return Opcode::CPU_ANNN;
+    case 0xB000: return Opcode::CPU_BNNN;
+    case 0xC000: return Opcode::CPU_CXNN;
+    case 0xD000: return Opcode::CPU_DXYN;
+    case 0xE000:
+        switch (opcode & 0x00FF) {
+        case 0x009E: return Opcode::CPU_EX9E;
+        case 0x00A1: return Opcode::CPU_EXA1;
+        } break;
+    case 0xF000:
+        switch (opcode & 0x00FF) {
+        case 0x0007: return Opcode::CPU_FX07;
+        case 0x000A: return Opcode::CPU_FX0A;
+        case 0x0015: return Opcode::CPU_FX15;
+        case 0x0018: return Opcode::CPU_FX18;
+        case 0x001E: return Opcode::CPU_FX1E;
+        case 0x0029: return Opcode::CPU_FX29;
+        case 0x0033: return Opcode::CPU_FX33;
+        case 0x0055: return Opcode::CPU_FX55;
+        case 0x0065: return Opcode::CPU_FX65;
+        } break;
+    }
+
+    return Opcode::Invalid;
+}
+
+/**
+ * Predecoded instruction with all operands already unpacked from the opcode.
+ * Packed into 8 bytes so a whole ROM worth of instructions stays in the cache.
+ */
+struct MicroOp
+{
+    constexpr MicroOp() = default;
+    constexpr explicit MicroOp(uint16_t opcode)
+        : x{static_cast<uint8_t>((opcode & 0x0F00) >> 8)},
+          y{static_cast<uint8_t>((opcode & 0x00F0) >> 4)},
+          n{static_cast<uint8_t>(opcode & 0x000F)},
+          nn{static_cast<uint8_t>(opcode & 0x00FF)},
+          nnn{static_cast<uint16_t>(opcode & 0x0FFF)} {};
+
+    Opcode type{Opcode::Invalid};
+    uint8_t x{0};
+    uint8_t y{0};
+    uint8_t n{0};
+    uint8_t nn{0};
+    bool valid{false};
+    uint16_t nnn{0};
+};
+
+/**
+ * Common instruction sequences which get fused into one superinstruction.
+ * A superinstruction always starts at the address of its first instruction.
+ */
+enum class Superinstruction : uint8_t
+{
+    None,
+    LoadDraw,  // ANNN followed by DXYN
+    DelayWait, // FX07, 3X00, 1NNN back to FX07
+    LoadRun,   // Run of 6XNN register loads
+    FontDraw   // FX29 followed by DXY5
+};
+
+struct Fusion
+{
+    Superinstruction type{Superinstruction::None};
+    uint8_t length{0}; // Number of fused instructions
+};
+
+// Fully decode an opcode into a valid micro-op
+constexpr MicroOp predecode(uint16_t opcode)
+{
+    MicroOp op{opcode};
+    op.type = decodeOpcode(opcode);
+    op.valid = true;
+    return op;
+}
+
+#endif
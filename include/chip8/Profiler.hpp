@@ -0,0 +1,85 @@
+//--------------------------------------------------------------------------------------------------
+// Cross-Platform Chip-8 Emulator
+// Copyright (C) 2020 Enrico Schörnick
+// Licensed under the MIT License
+//--------------------------------------------------------------------------------------------------
+
+#ifndef CHIP8_PROFILER_HPP
+#define CHIP8_PROFILER_HPP
+
+#include "Opcode.hpp"
+#include "Chip8.hpp"
+
+#include <array>
+#include <string>
+#include <chrono>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/**
+ * Execution count and cost of every instruction class and of every memory
+ * address. The Chip8 only feeds a profiler if it was built with
+ * CHIP8_PROFILE, otherwise profiling costs nothing. Costs are TSC cycles on
+ * x86, nanoseconds everywhere else, and include the fetch and dispatch of
+ * the decoder the instruction ran with.
+ */
+class Profiler
+{
+public:
+    static uint64_t readCycles()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        using namespace std::chrono;
+        return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    void record(Opcode type, uint16_t address, uint64_t cycles)
+    {
+        auto &entry = entries[static_cast<size_t>(type)];
+        entry.count++;
+        entry.cycles += cycles;
+
+        // Address counters stop at their maximum instead of wrapping
+        addressCounts[address] += (addressCounts[address] != UINT32_MAX);
+        addressCycles[address] += cycles;
+    }
+
+    void clear();
+    uint64_t getCount(Opcode type) const;
+    uint64_t getCycles(Opcode type) const;
+    uint32_t getAddressCount(uint16_t address) const;
+    uint64_t getAddressCycles(uint16_t address) const;
+
+    // Writes CSV if the path ends with .csv, JSON otherwise
+    bool save(const std::string &path) const;
+
+    // Executed addresses sorted by the time spent on them, annotated with their disassembly
+    bool saveHotSpots(const std::string &path, const Chip8State &state) const;
+
+    // Every instruction of the game, marked with + if it was executed and - if it never was
+    bool saveCoverage(const std::string &path, const Chip8State &state) const;
+
+private:
+    struct Entry
+    {
+        uint64_t count{0};
+        uint64_t cycles{0};
+    };
+
+    std::array<Entry, kOpcodeCount> entries{};
+    std::array<uint32_t, 4096> addressCounts{};
+    std::array<uint64_t, 4096> addressCycles{};
+
+    void writeJson(std::ostream &stream) const;
+    void writeCsv(std::ostream &stream) const;
+    void writeHotSpots(std::ostream &stream, const Chip8State &state) const;
+    void writeCoverage(std::ostream &stream, const Chip8State &state) const;
+};
+
+#endif
@@ -11,13 +11,14 @@
 
 #include <SDL.h>
 #include <iostream>
+#include <string_view>
 
 // Predefined elements which can be drawn
 struct TextWidget
 {
     int xPos;
     int yPos;
-    const std::string &text;
+    std::string_view text;
     bool highlighted{false};
 };
 
@@ -0,0 +1,71 @@
+//--------------------------------------------------------------------------------------------------
+// Cross-Platform Chip-8 Emulator
+// Copyright (C) 2020 Enrico Schörnick
+// Licensed under the MIT License
+//--------------------------------------------------------------------------------------------------
+
+#ifndef CHIP8_REWINDBUFFER_HPP
+#define CHIP8_REWINDBUFFER_HPP
+
+#include "Chip8.hpp"
+
+#include <array>
+#include <bitset>
+#include <memory>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * History of the machine state with one entry per frame. The frames of each
+ * second form a group which starts with a full keyframe, the following frames
+ * only store the 64 byte blocks which changed since the frame before. These
+ * blocks are stored XORed with the keyframe, so only their non-zero words
+ * are kept. Restoring a frame copies the keyframe and applies the newest
+ * version of every changed block, walking back at most one group.
+ */
+class RewindBuffer
+{
+public:
+    static constexpr size_t kFramesPerSecond{60};
+
+    explicit RewindBuffer(size_t seconds = 300);
+
+    void push(const MachineState &state);
+    bool stepBack(MachineState &state);
+    void clear();
+
+    size_t getFrames() const;
+    size_t getMemoryUsage() const;
+
+private:
+    static constexpr size_t kBlockSize{64};
+    static constexpr size_t kBlockCount{sizeof(MachineState) / kBlockSize};
+    static constexpr size_t kWordsPerBlock{kBlockSize / sizeof(uint64_t)};
+    static constexpr size_t kKeyframeInterval{kFramesPerSecond};
+
+    static_assert(sizeof(MachineState) % kBlockSize == 0, "MachineState has to consist of whole blocks");
+
+    struct Delta
+    {
+        std::bitset<kBlockCount> blocks; // Blocks which changed since the frame before
+        std::vector<uint8_t> masks;      // Non-zero words of every changed block
+        std::vector<uint64_t> words;     // Non-zero words XORed with the keyframe
+    };
+
+    struct Group
+    {
+        std::unique_ptr<MachineState> keyframe;
+        std::array<Delta, kKeyframeInterval> frames; // Frame 0 is the keyframe itself
+        size_t count{0};
+    };
+
+    std::vector<Group> groups;
+    size_t newestGroup{0};
+    size_t groupCount{0};
+    std::unique_ptr<MachineState> previous;
+
+    void restore(const Group &group, size_t frame, MachineState &state) const;
+};
+
+#endif
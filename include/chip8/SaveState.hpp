@@ -0,0 +1,69 @@
+//--------------------------------------------------------------------------------------------------
+// Cross-Platform Chip-8 Emulator
+// Copyright (C) 2020 Enrico Schörnick
+// Licensed under the MIT License
+//--------------------------------------------------------------------------------------------------
+
+#ifndef CHIP8_SAVESTATE_HPP
+#define CHIP8_SAVESTATE_HPP
+
+#include "Chip8.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Save state file: a 64 byte header followed by the MachineState exactly as
+ * it is laid out in memory. Files are mapped instead of read where possible,
+ * so the state can be used directly from the mapping. The version changes
+ * whenever MachineState changes, files of other versions get rejected.
+ */
+struct SaveStateHeader
+{
+    static constexpr char kMagic[8]{'C', 'H', 'I', 'P', '8', 'S', 'A', 'V'};
+    static constexpr uint32_t kVersion{3};
+    static constexpr uint16_t kByteOrder{0x0102};
+
+    char magic[8];
+    uint32_t version;
+    uint32_t stateSize;
+    uint16_t byteOrder;
+    char game[46]; // Name of the game, for information only
+};
+
+static_assert(sizeof(SaveStateHeader) == 64, "MachineState has to start at an aligned offset");
+
+class SaveStateFile
+{
+public:
+    SaveStateFile() = default;
+    ~SaveStateFile();
+
+    // SaveStateFile owns its mapping -- no copy/move operators
+    SaveStateFile(const SaveStateFile &) = delete;
+    SaveStateFile &operator=(const SaveStateFile &) = delete;
+    SaveStateFile(SaveStateFile &&) = delete;
+    SaveStateFile &operator=(SaveStateFile &&) = delete;
+
+    static bool write(const std::string &path, const MachineState &state, const std::string &game);
+
+    bool open(const std::string &path);
+    void close();
+
+    const MachineState *getState() const;
+    std::string getGame() const;
+
+private:
+    const uint8_t *data{nullptr};
+    size_t size{0};
+    bool mapped{false};
+    std::vector<uint8_t> buffer;
+    std::unique_ptr<MachineState> copy;
+
+    bool isValid() const;
+};
+
+#endif
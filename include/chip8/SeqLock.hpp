@@ -0,0 +1,55 @@
+//--------------------------------------------------------------------------------------------------
+// Cross-Platform Chip-8 Emulator
+// Copyright (C) 2020 Enrico Schörnick
+// Licensed under the MIT License
+//--------------------------------------------------------------------------------------------------
+
+#ifndef CHIP8_SEQLOCK_HPP
+#define CHIP8_SEQLOCK_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+/**
+ * Sequence lock for one writer thread and any number of readers. The
+ * sequence is odd while the writer copies a new value, readers retry until
+ * they copied the value without a write in between. The writer never waits.
+ */
+template <typename T>
+class SeqLock
+{
+    static_assert(std::is_trivially_copyable_v<T>, "SeqLock values get copied with memcpy");
+
+public:
+    void store(const T &newValue)
+    {
+        const auto sequence = this->sequence.load(std::memory_order_relaxed);
+        this->sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        memcpy(static_cast<void *>(&value), &newValue, sizeof(T));
+        this->sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    T load() const
+    {
+        T result;
+        uint32_t before;
+        uint32_t after;
+        do
+        {
+            before = sequence.load(std::memory_order_acquire);
+            memcpy(static_cast<void *>(&result), &value, sizeof(T));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = sequence.load(std::memory_order_relaxed);
+        } while ((before & 0x1) != 0 || before != after);
+        return result;
+    }
+
+private:
+    alignas(64) std::atomic<uint32_t> sequence{0};
+    T value{};
+};
+
+#endif
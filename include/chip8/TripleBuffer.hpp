@@ -0,0 +1,62 @@
+//--------------------------------------------------------------------------------------------------
+// Cross-Platform Chip-8 Emulator
+// Copyright (C) 2020 Enrico Schörnick
+// Licensed under the MIT License
+//--------------------------------------------------------------------------------------------------
+
+#ifndef CHIP8_TRIPLEBUFFER_HPP
+#define CHIP8_TRIPLEBUFFER_HPP
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Lock-free triple buffer for one writer and one reader thread. The writer
+ * owns one slot, the reader another one and the third one holds the newest
+ * published value. Publishing and fetching swap slot indices with a single
+ * atomic exchange, so neither side ever waits for the other one.
+ */
+template <typename T>
+class TripleBuffer
+{
+public:
+    // Writer side: fill the write buffer, then publish it
+    T &getWriteBuffer()
+    {
+        return slots[back];
+    }
+
+    void publish()
+    {
+        back = middle.exchange(back | kFresh, std::memory_order_acq_rel) & kIndex;
+    }
+
+    // Reader side: returns true if a newer value replaced the read buffer
+    bool update()
+    {
+        if ((middle.load(std::memory_order_relaxed) & kFresh) == 0)
+        {
+            return false;
+        }
+
+        front = middle.exchange(front, std::memory_order_acq_rel) & kIndex;
+        return true;
+    }
+
+    const T &getReadBuffer() const
+    {
+        return slots[front];
+    }
+
+private:
+    static constexpr uint8_t kIndex{0x3};
+    static constexpr uint8_t kFresh{0x4};
+
+    std::array<T, 3> slots{};
+    alignas(64) std::atomic<uint8_t> middle{1};
+    alignas(64) uint8_t back{0};
+    alignas(64) uint8_t front{2};
+};
+
+#endif
@@ -10,11 +10,16 @@
 #include "chip8/Chip8.hpp"
 #include "chip8/SoundManager.hpp"
 #include "chip8/MemoryDumper.hpp"
+#include "chip8/InputMovie.hpp"
+#include "chip8/Profiler.hpp"
+#include "chip8/EmulationThread.hpp"
 #include "chip8/RenderManager.hpp"
+#include "chip8/RewindBuffer.hpp"
 #include "chip8/sections/ISection.hpp"
 
 #include <SDL.h>
 #include <memory>
+#include <string>
 #include <vector>
 #include <cstdint>
 
@@ -26,37 +31,60 @@ public:
     bool initialize();
     void run();
 
+    // Records every input from now on, the movie gets written when the emulator exits
+    void startRecording(const std::string &path);
+
 private:
     Chip8 &chip8;
+    Chip8State view{};
     SDL_Window *window;
     SDL_Renderer *renderer;
     bool warpMode{false};
+    bool rewinding{false};
+    bool resumeAfterRewind{false};
+    uint64_t titleInstructions{0};
 
     std::unique_ptr<SoundManager> soundManager{};
     std::unique_ptr<MemoryDumper> memoryDumper{};
     std::shared_ptr<RenderManager> renderManager{};
+    std::unique_ptr<EmulationThread> emulation{};
+    std::unique_ptr<RewindBuffer> rewindBuffer{};
+    std::unique_ptr<MachineState> rewindState{};
+    std::unique_ptr<InputMovie> movie{};
+    std::string moviePath{};
+#ifdef CHIP8_PROFILE
+    Profiler profiler{};
+#endif
     std::vector<std::unique_ptr<ISection>> sections{};
 
     SDL_TimerID redrawTimerId;
-    SDL_TimerID emulatorTimerId;
 
     static const int kRedrawEvent{0};
-    static const int kCatchUpEvent{1};
     static const int kRedrawInterval{17};
-    static const int kCatchUpInterval{2};
+    static constexpr const char *kWindowTitle{"Chip-8 Emulator"};
+#ifdef CHIP8_PROFILE
+    static constexpr const char *kProfilePath{"profile.json"};
+    static constexpr const char *kHotSpotPath{"hotspots.txt"};
+    static constexpr const char *kCoveragePath{"coverage.txt"};
+#endif
 
     bool initializeWindow();
     void startRedrawTimer();
-    void startEmulatorTimer();
     void stopTimer(SDL_TimerID timerId);
-    void handleTimerEvent(SDL_Event &event, const Chip8State &state);
-    void handleInputEvent(SDL_Event &event, const Chip8State &state);
+    void handleTimerEvent(SDL_Event &event);
+    void handleInputEvent(SDL_Event &event);
     void handleDropEvent(SDL_Event &event);
+    void loadGame(const std::string &path);
     void startWarpMode();
     void stopWarpMode();
-    void warp();
+    void startRewind();
+    void stopRewind();
     static uint32_t timerCallback(uint32_t interval, void *param);
     void updateScreen();
+    void updateTitle();
+#ifdef CHIP8_PROFILE
+    void saveProfile(const Chip8State &state);
+#endif
 };
 
 #endif
\ No newline at end of file
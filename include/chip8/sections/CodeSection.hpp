@@ -7,8 +7,11 @@
 #ifndef CHIP8_CODESECTION_HPP
 #define CHIP8_CODESECTION_HPP
 
+#include "chip8/Disassembler.hpp"
 #include "chip8/sections/ISection.hpp"
 
+#include <array>
+
 class CodeSection : public ISection
 {
 public:
@@ -23,12 +26,23 @@ public:
     void redraw(const Chip8State &state) override;
 
 private:
+    static constexpr int kMaxLines{25};
+    static constexpr int kInstructionSize{2};
+
     void drawSectionBox() const override;
     void renderCode(const Chip8State &state);
+    void layoutLines(const Chip8State &state, int endAddress);
     
-    // Address of the first and last displayed instruction in section
+    // Address of the first displayed instruction in section
     int topInstruction{0};
-    int bottomInstruction{0};
+
+    // Address and role of every displayed line, data bytes in front of misaligned code take one byte
+    std::array<int, kMaxLines> lines{};
+    std::array<Disassembler::Role, kMaxLines> roles{};
+    int lineCount{0};
+
+    // Only the shown lines get disassembled, straight from the memory of the view
+    std::unique_ptr<Disassembler> disassembler{std::make_unique<Disassembler>()};
 };
 
 #endif
\ No newline at end of file
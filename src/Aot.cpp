@@ -0,0 +1,83 @@
+//--------------------------------------------------------------------------------------------------
+// Cross-Platform Chip-8 Emulator
+// Copyright (C) 2020 Enrico Schörnick
+// Licensed under the MIT License
+//--------------------------------------------------------------------------------------------------
+
+#include "chip8/Aot.hpp"
+
+#include <vector>
+#include <cstring>
+
+namespace
+{
+    // Function local static, so registration works independent of initialization order
+    std::vector<const AotModule *> &getModules()
+    {
+        static std::vector<const AotModule *> modules;
+        return modules;
+    }
+}
+
+AotRegistrar::AotRegistrar(const AotModule &module)
+{
+    getModules().push_back(&module);
+}
+
+AotProgram::AotProgram(const AotModule &module) : module{module}
+{
+    for (size_t i = 0; i < module.blockCount; i++)
+    {
+        const auto &block = module.blocks[i];
+        blocks[block.start & 0xFFF] = &block;
+        for (int address = block.start; address < block.end; address++)
+        {
+            code.set(address & 0xFFF);
+        }
+    }
+}
+
+const AotModule *AotProgram::find(const uint8_t *rom, size_t size)
+{
+    // Games are identified by their content, the file name doesn't matter
+    for (const auto module : getModules())
+    {
+        if (module->romSize == size && memcmp(module->rom, rom, size) == 0)
+        {
+            return module;
+        }
+    }
+    return nullptr;
+}
+
+const AotBlock *AotProgram::getBlock(uint16_t address) const
+{
+    return blocks[address & 0xFFF];
+}
+
+void AotProgram::invalidate(uint16_t address, uint16_t length)
+{
+    const int first = address;
+    const int last = address + length;
+
+    // Most writes hit data, so first check if compiled code is affected at all
+    auto hitsCode = false;
+    for (int i = first; i < last; i++)
+    {
+        hitsCode |= code[i & 0xFFF];
+    }
+
+    if (!hitsCode)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < module.blockCount; i++)
+    {
+        const auto &block = module.blocks[i];
+        if (block.start < last && first < block.end)
+        {
+            blocks[block.start & 0xFFF] = nullptr;
+        }
+    }
+}
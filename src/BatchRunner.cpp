@@ -0,0 +1,333 @@
+//--------------------------------------------------------------------------------------------------
+// Cross-Platform Chip-8 Emulator
+// Copyright (C) 2020 Enrico Schörnick
+// Licensed under the MIT License
+//--------------------------------------------------------------------------------------------------
+
+#include "chip8/BatchRunner.hpp"
+
+#include <map>
+#include <tuple>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+
+namespace
+{
+    const int kFramesPerSecond{60};
+
+    void applyInput(std::vector<BatchInput>::const_iterator &input, const std::vector<BatchInput> &inputs,
+                    uint64_t frame, uint16_t &keys)
+    {
+        for (; input != inputs.end() && input->frame <= frame; input++)
+        {
+            keys = input->keys;
+        }
+    }
+
+    // Instructions of the next frame, the remainder carries over like in Chip8::runFrame
+    uint64_t getFrameBudget(int speed, uint64_t &remainder)
+    {
+        const auto budget = speed + remainder;
+        remainder = budget % kFramesPerSecond;
+        return budget / kFramesPerSecond;
+    }
+}
+
+BatchRunner::BatchRunner(unsigned threads) : threads{threads}
+{
+    if (this->threads == 0)
+    {
+        this->threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for (unsigned i = 0; i < this->threads; i++)
+    {
+        workers.push_back(std::make_unique<Worker>());
+    }
+}
+
+unsigned BatchRunner::getThreads() const
+{
+    return threads;
+}
+
+const std::vector<WorkerStats> &BatchRunner::getStats() const
+{
+    return stats;
+}
+
+void BatchRunner::setLockstep(bool enabled)
+{
+    lockstep = enabled;
+}
+
+std::vector<BatchResult> BatchRunner::run(const std::vector<BatchJob> &jobs)
+{
+    std::vector<BatchResult> results(jobs.size());
+    createPacks(jobs);
+
+    // Hand out contiguous ranges, stealing evens out the different job lengths
+    for (unsigned i = 0; i < threads; i++)
+    {
+        auto &worker = *workers[i];
+        worker.stats = WorkerStats{};
+        worker.queue.clear();
+        for (size_t pack = packs.size() * i / threads; pack < packs.size() * (i + 1) / threads; pack++)
+        {
+            worker.queue.push_back(pack);
+        }
+    }
+
+    std::vector<std::thread> pool;
+    for (unsigned i = 1; i < threads; i++)
+    {
+        pool.emplace_back(&BatchRunner::work, this, i, std::cref(jobs), std::ref(results));
+    }
+    work(0, jobs, results);
+
+    for (auto &thread : pool)
+    {
+        thread.join();
+    }
+
+    stats.clear();
+    for (const auto &worker : workers)
+    {
+        stats.push_back(worker->stats);
+    }
+
+    return results;
+}
+
+void BatchRunner::createPacks(const std::vector<BatchJob> &jobs)
+{
+    packs.clear();
+    if (!lockstep)
+    {
+        for (size_t job = 0; job < jobs.size(); job++)
+        {
+            packs.push_back({job});
+        }
+        return;
+    }
+
+    // Jobs which only differ in their input and seed can share one engine
+    std::map<std::tuple<std::string, const MachineState *, uint64_t, int>, size_t> openPacks;
+    for (size_t job = 0; job < jobs.size(); job++)
+    {
+        const auto key = std::make_tuple(jobs[job].gamePath, jobs[job].startState.get(), jobs[job].frames,
+                                         jobs[job].instructionsPerSecond);
+        auto openPack = openPacks.find(key);
+        if (openPack == openPacks.end() || packs[openPack->second].size() == LockstepEngine::kLanes)
+        {
+            openPacks[key] = packs.size();
+            packs.push_back({job});
+        }
+        else
+        {
+            packs[openPack->second].push_back(job);
+        }
+    }
+}
+
+void BatchRunner::work(unsigned index, const std::vector<BatchJob> &jobs, std::vector<BatchResult> &results)
+{
+    using namespace std::chrono;
+
+    auto &worker = *workers[index];
+    size_t pack;
+
+    while (takePack(index, pack))
+    {
+        if (lockstep)
+        {
+            runLockstep(worker, jobs, packs[pack], results);
+        }
+        else
+        {
+            const auto job = packs[pack].front();
+            const auto startTime = steady_clock::now();
+            runJob(getInstance(worker, jobs[job].decoder), jobs[job], results[job]);
+            results[job].seconds = duration<double>(steady_clock::now() - startTime).count();
+        }
+
+        for (auto job : packs[pack])
+        {
+            results[job].worker = index;
+            worker.stats.jobs++;
+            worker.stats.instructions += results[job].instructions;
+            worker.stats.seconds += results[job].seconds;
+        }
+    }
+}
+
+bool BatchRunner::takePack(unsigned index, size_t &pack)
+{
+    auto &own = *workers[index];
+    {
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.queue.empty())
+        {
+            pack = own.queue.back();
+            own.queue.pop_back();
+            return true;
+        }
+    }
+
+    // Jobs never create new jobs, so one round without success means everything is taken
+    for (unsigned i = 1; i < threads; i++)
+    {
+        auto &victim = *workers[(index + i) % threads];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.queue.empty())
+        {
+            pack = victim.queue.front();
+            victim.queue.pop_front();
+            own.stats.steals++;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+Chip8 &BatchRunner::getInstance(Worker &worker, Decoder decoder)
+{
+    auto &instance = worker.pool[static_cast<size_t>(decoder)];
+    if (!instance)
+    {
+        instance = std::make_unique<Chip8>();
+        instance->setDecoder(decoder);
+    }
+    return *instance;
+}
+
+void BatchRunner::runJob(Chip8 &chip8, const BatchJob &job, BatchResult &result)
+{
+    if (!chip8.loadGame(job.gamePath))
+    {
+        return;
+    }
+
+    if (job.startState)
+    {
+        chip8.loadState(*job.startState);
+    }
+    chip8.setSeed(job.seed);
+
+    const auto &state = chip8.getState();
+    const int speed = (job.instructionsPerSecond > 0) ? job.instructionsPerSecond : state.instructionsPerSecond;
+    uint64_t remainder = 0;
+
+    result.loaded = true;
+    result.framesHash = state.getDisplayHash();
+
+    auto input = job.inputs.begin();
+    uint16_t keys = 0;
+    chip8.start();
+
+    for (uint64_t frame = 0; frame < job.frames && state.isRunning; frame++)
+    {
+        // Apply the keypad state which is valid from this frame on
+        applyInput(input, job.inputs, frame, keys);
+        for (int key = 0; key < 16; key++)
+        {
+            chip8.setButton((keys >> key) & 0x1, key);
+        }
+
+        result.instructions += chip8.execute(getFrameBudget(speed, remainder));
+        chip8.updateTimers();
+        result.framesHash = state.getDisplayHash(result.framesHash);
+    }
+
+    result.displayHash = state.getDisplayHash();
+    result.V = state.V;
+    result.I = state.I;
+    result.instructionPointer = state.instructionPointer;
+    result.stackPointer = state.stackPointer;
+    result.delayTimer = state.delayTimer;
+    result.soundTimer = state.soundTimer;
+}
+
+void BatchRunner::runLockstep(Worker &worker, const std::vector<BatchJob> &jobs, const std::vector<size_t> &pack,
+                              std::vector<BatchResult> &results)
+{
+    using namespace std::chrono;
+    const auto startTime = steady_clock::now();
+
+    // Every job of the pack has the same game, so one instance loads it for all lanes
+    const auto &first = jobs[pack.front()];
+    auto &chip8 = getInstance(worker, Decoder::Cached);
+    if (!chip8.loadGame(first.gamePath))
+    {
+        return;
+    }
+
+    if (!worker.lockstep)
+    {
+        worker.lockstep = std::make_unique<LockstepEngine>();
+    }
+    auto &engine = *worker.lockstep;
+    const auto &startState = first.startState ? *first.startState : chip8.getState();
+    engine.loadState(startState);
+    const auto startCount = startState.instructionCount;
+
+    const int speed = (first.instructionsPerSecond > 0) ? first.instructionsPerSecond
+                      : first.startState ? first.startState->instructionsPerSecond
+                                         : chip8.getState().instructionsPerSecond;
+    uint64_t remainder = 0;
+
+    // Unused lanes run without input, their results get dropped
+    std::array<std::vector<BatchInput>::const_iterator, LockstepEngine::kLanes> inputs;
+    std::array<uint16_t, LockstepEngine::kLanes> keys{};
+    for (size_t lane = 0; lane < pack.size(); lane++)
+    {
+        const auto &job = jobs[pack[lane]];
+        inputs[lane] = job.inputs.begin();
+        engine.setSeed(lane, job.seed);
+        results[pack[lane]].loaded = true;
+        results[pack[lane]].framesHash = engine.getDisplayHash(lane);
+    }
+
+    for (uint64_t frame = 0; frame < first.frames; frame++)
+    {
+        for (size_t lane = 0; lane < pack.size(); lane++)
+        {
+            applyInput(inputs[lane], jobs[pack[lane]].inputs, frame, keys[lane]);
+        }
+        for (int lane = 0; lane < LockstepEngine::kLanes; lane++)
+        {
+            engine.setKeys(lane, keys[lane]);
+        }
+
+        engine.execute(getFrameBudget(speed, remainder));
+        engine.updateTimers();
+
+        for (size_t lane = 0; lane < pack.size(); lane++)
+        {
+            auto &result = results[pack[lane]];
+            result.framesHash = engine.getDisplayHash(lane, result.framesHash);
+        }
+    }
+
+    // The lanes share the time of the engine
+    const auto seconds = duration<double>(steady_clock::now() - startTime).count() / pack.size();
+
+    MachineState state;
+    for (size_t lane = 0; lane < pack.size(); lane++)
+    {
+        auto &result = results[pack[lane]];
+        engine.storeState(lane, state);
+
+        result.instructions = state.instructionCount - startCount;
+        result.seconds = seconds;
+        result.displayHash = state.getDisplayHash();
+        result.V = state.V;
+        result.I = state.I;
+        result.instructionPointer = state.instructionPointer;
+        result.stackPointer = state.stackPointer;
+        result.delayTimer = state.delayTimer;
+        result.soundTimer = state.soundTimer;
+    }
+}
@@ -5,22 +5,124 @@
 //--------------------------------------------------------------------------------------------------
 
 #include "chip8/Chip8.hpp"
+#include "chip8/SaveState.hpp"
+#include "chip8/InputQueue.hpp"
+#include "chip8/InputMovie.hpp"
+#include "chip8/Profiler.hpp"
 
 #include <cstring>
 #include <fstream>
-#include <sstream>
 #include <iostream>
 #include <algorithm>
 #include <filesystem>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 // Defines that simplifiy opcode and register handling
-#define N (opcode & 0x000F)
-#define NN (opcode & 0x00FF)
-#define NNN (opcode & 0x0FFF)
-#define X ((opcode & 0x0F00) >> 8)
-#define Y ((opcode & 0x00F0) >> 4)
-#define VX state.V[(opcode & 0x0F00) >> 8]
-#define VY state.V[(opcode & 0x00F0) >> 4]
+#define N (op.n)
+#define NN (op.nn)
+#define NNN (op.nnn)
+#define X (op.x)
+#define Y (op.y)
+#define VX state.V[op.x]
+#define VY state.V[op.y]
+
+namespace
+{
+    // Command line names of the decoders
+    const std::pair<const char *, Decoder> kDecoderNames[] = {
+        {"switch", Decoder::Switch}, {"table", Decoder::Table}, {"cached", Decoder::Cached},
+        {"threaded", Decoder::Threaded}, {"jit", Decoder::Jit}, {"aot", Decoder::Aot}};
+
+    // Instructions which neither write memory, the stack or the display nor draw random numbers
+    bool isIdleInstruction(Opcode type)
+    {
+        switch (type) {
+        case Opcode::CPU_1NNN: case Opcode::CPU_3XNN: case Opcode::CPU_4XNN: case Opcode::CPU_5XY0:
+        case Opcode::CPU_6XNN: case Opcode::CPU_7XNN: case Opcode::CPU_8XY0: case Opcode::CPU_8XY1:
+        case Opcode::CPU_8XY2: case Opcode::CPU_8XY3: case Opcode::CPU_8XY4: case Opcode::CPU_8XY5:
+        case Opcode::CPU_8XY6: case Opcode::CPU_8XY7: case Opcode::CPU_8XYE: case Opcode::CPU_9XY0:
+        case Opcode::CPU_ANNN: case Opcode::CPU_BNNN: case Opcode::CPU_EX9E: case Opcode::CPU_EXA1:
+        case Opcode::CPU_FX07: case Opcode::CPU_FX15: case Opcode::CPU_FX18: case Opcode::CPU_FX1E:
+        case Opcode::CPU_FX29: case Opcode::CPU_FX65:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    /**
+     * XOR sprite rows into the display and report if any set pixel got cleared.
+     * Uses AVX2 (4 rows) or SSE2 (2 rows) if the compiler targets them.
+     */
+    bool xorSpriteRows(uint64_t *display, const uint64_t *sprite, int rows)
+    {
+        uint64_t collision = 0;
+        int y = 0;
+
+#if defined(__AVX2__)
+        auto collisions256 = _mm256_setzero_si256();
+        for (; y + 4 <= rows; y += 4)
+        {
+            auto displayRows = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(display + y));
+            auto spriteRows = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(sprite + y));
+            collisions256 = _mm256_or_si256(collisions256, _mm256_and_si256(displayRows, spriteRows));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(display + y), _mm256_xor_si256(displayRows, spriteRows));
+        }
+        collision |= !_mm256_testz_si256(collisions256, collisions256);
+#endif
+
+#if defined(__SSE2__)
+        auto collisions128 = _mm_setzero_si128();
+        for (; y + 2 <= rows; y += 2)
+        {
+            auto displayRows = _mm_loadu_si128(reinterpret_cast<const __m128i *>(display + y));
+            auto spriteRows = _mm_loadu_si128(reinterpret_cast<const __m128i *>(sprite + y));
+            collisions128 = _mm_or_si128(collisions128, _mm_and_si128(displayRows, spriteRows));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(display + y), _mm_xor_si128(displayRows, spriteRows));
+        }
+        collision |= _mm_movemask_epi8(_mm_cmpeq_epi8(collisions128, _mm_setzero_si128())) != 0xFFFF;
+#endif
+
+        for (; y < rows; y++)
+        {
+            collision |= display[y] & sprite[y];
+            display[y] ^= sprite[y];
+        }
+
+        return collision != 0;
+    }
+}
+
+// Handler of every instruction class, indexed by the Opcode enum
+const std::array<Chip8::Handler, kOpcodeCount> Chip8::handlers{
+    &Chip8::CPU_INVALID,
+    &Chip8::CPU_00E0, &Chip8::CPU_00EE, &Chip8::CPU_1NNN, &Chip8::CPU_2NNN,
+    &Chip8::CPU_3XNN, &Chip8::CPU_4XNN, &Chip8::CPU_5XY0, &Chip8::CPU_6XNN,
+    &Chip8::CPU_7XNN, &Chip8::CPU_8XY0, &Chip8::CPU_8XY1, &Chip8::CPU_8XY2,
+    &Chip8::CPU_8XY3, &Chip8::CPU_8XY4, &Chip8::CPU_8XY5, &Chip8::CPU_8XY6,
+    &Chip8::CPU_8XY7, &Chip8::CPU_8XYE, &Chip8::CPU_9XY0, &Chip8::CPU_ANNN,
+    &Chip8::CPU_BNNN, &Chip8::CPU_CXNN, &Chip8::CPU_DXYN, &Chip8::CPU_EX9E,
+    &Chip8::CPU_EXA1, &Chip8::CPU_FX07, &Chip8::CPU_FX0A, &Chip8::CPU_FX15,
+    &Chip8::CPU_FX18, &Chip8::CPU_FX1E, &Chip8::CPU_FX29, &Chip8::CPU_FX33,
+    &Chip8::CPU_FX55, &Chip8::CPU_FX65};
+
+// Instruction class of every possible opcode (64 KB, built once at startup)
+const std::array<Opcode, 0x10000> Chip8::opcodeTable{Chip8::buildOpcodeTable()};
+
+std::array<Opcode, 0x10000> Chip8::buildOpcodeTable()
+{
+    std::array<Opcode, 0x10000> table{};
+    for (size_t i = 0; i < table.size(); i++)
+    {
+        table[i] = decodeOpcode(static_cast<uint16_t>(i));
+    }
+    return table;
+}
 
 bool Chip8::loadGame(const std::string &gamePath)
 {
@@ -53,7 +155,15 @@ bool Chip8::loadGame(const std::string &gamePath)
 
     state.instructionsPerSecond = state.game->getBestSpeed();
 
-    disassembleInstructions();
+    analyzeControlFlow();
+    predecodeInstructions();
+    fuseInstructions();
+    findIdleLoops();
+
+    if (decoder == Decoder::Aot)
+    {
+        loadAotProgram();
+    }
 
     return true;
 }
@@ -69,18 +179,28 @@ void Chip8::initialize()
     state.stackPointer = 0;
     state.V.fill(0);
     state.instructionPointer = state.kStartAddress;
+    state.instructionCount = 0;
+    state.random = seed;
+    state.waitingForKey = false;
+    state.keyRegister = 0;
 
     state.keypad.fill(false);
     state.stack.fill(0);
-    state.display.fill(false);
+    state.display.fill(0);
     state.memory.fill(0);
 
     // Copy fontset to memory location 0x0000
     std::copy(fontset, fontset + sizeof(fontset), state.memory.data());
 
     state.breakpoints.clear();
-    state.disassembly.clear();
     resetTime();
+    frameRemainder = 0;
+    flushInput();
+
+    if (jit)
+    {
+        jit->reset();
+    }
 }
 
 void Chip8::resetTime()
@@ -89,73 +209,80 @@ void Chip8::resetTime()
     startTime = std::chrono::steady_clock::now();
 }
 
-void Chip8::disassembleInstructions()
+bool MachineState::isValid() const
+{
+    // Everything the instructions use as index without further checks
+    return stackPointer <= stack.size() && I < memory.size() && instructionPointer < memory.size() - 1 &&
+           keyRegister < V.size() && random != 0;
+}
+
+uint64_t MachineState::getDisplayHash(uint64_t hash) const
 {
-    // Walk through memory and disassemble every instruction
-    for (int i = state.kStartAddress; i < state.kStartAddress + state.game->size; i += sizeof(opcode))
+    for (auto row : display)
     {
-        state.disassembly.push_back(disassemble(i));
+        for (int i = 0; i < 8; i++)
+        {
+            hash = (hash ^ ((row >> (i * 8)) & 0xFF)) * 0x100000001B3;
+        }
     }
+    return hash;
 }
 
-std::string Chip8::disassemble(uint16_t address)
+bool parseDecoder(const std::string &name, Decoder &decoder)
 {
-    uint16_t opcode = state.memory[address] << 8 | state.memory[address + 1];
+    for (const auto &[decoderName, value] : kDecoderNames)
+    {
+        if (name == decoderName)
+        {
+            decoder = value;
+            return true;
+        }
+    }
 
-    std::stringstream str;
-    str << std::hex << address << " - ";
+    std::cout << "Error: Unknown decoder " << name << " (use ";
+    const auto count = std::size(kDecoderNames);
+    for (size_t i = 0; i < count; i++)
+    {
+        std::cout << kDecoderNames[i].first << ((i + 2 < count) ? ", " : (i + 1 < count) ? " or " : ")");
+    }
+    std::cout << std::endl;
+    return false;
+}
 
-    // Create the string representation of the opcode
-    switch (opcode & 0xF000) {
-    case 0x0000:
-        switch (opcode & 0x000F) {
-        case 0x0000: str << "CLS"; break;
-        case 0x000E: str << "RET"; break;
-        } break;
-    case 0x1000: str << "JP    #" << NNN; break;
-    case 0x2000: str << "CALL  #" << NNN; break;
-    case 0x3000: str << "SE    V" << X << "   #" << NN; break;
-    case 0x4000: str << "SNE   V" << X << "   #" << NN; break;
-    case 0x5000: str << "SE    V" << X << "   V" << Y; break;
-    case 0x6000: str << "LD    V" << X << "   #" << NN; break;
-    case 0x7000: str << "ADD   V" << X << "   #" << NN; break;
-    case 0x8000:
-        switch (opcode & 0x000F) {
-        case 0x0000: str << "LD    V" << X << "   V" << Y; break;
-        case 0x0001: str << "OR    V" << X << "   V" << Y; break;
-        case 0x0002: str << "AND   V" << X << "   V" << Y; break;
-        case 0x0003: str << "XOR   V" << X << "   V" << Y; break;
-        case 0x0004: str << "ADD   V" << X << "   V" << Y; break;
-        case 0x0005: str << "SUB   V" << X << "   V" << Y; break;
-        case 0x0006: str << "SHR   V" << X; break;
-        case 0x0007: str << "SUBN  V" << X << "   V" << Y; break;
-        case 0x000E: str << "SHL   V" << X; break;
-        } break;
-    case 0x9000: str << "SNE   V" << X << "   V" << Y; break;
-    case 0xA000: str << "LD    I    #" << NNN; break;
-    case 0xB000: str << "JP    V0   #" << NNN; break;
-    case 0xC000: str << "RND   V" << X << "   #" << NN; break;
-    case 0xD000: str << "DRW   V" << X << "   V" << Y << "   #" << N; break;
-    case 0xE000:
-        switch (opcode & 0x00FF) {
-        case 0x009E: str << "SKP   V" << X; break;
-        case 0x00A1: str << "SKNP  V" << X; break;
-        } break;
-    case 0xF000:
-        switch (opcode & 0x00FF) {
-        case 0x0007: str << "LD    V" << X << "   DT"; break;
-        case 0x000A: str << "LD    V" << X << "   K"; break;
-        case 0x0015: str << "LD    DT   V" << X; break;
-        case 0x0018: str << "LD    ST   V" << X; break;
-        case 0x001E: str << "ADD   I    V" << X; break;
-        case 0x0029: str << "LD    F    V" << X; break;
-        case 0x0033: str << "BCD   V" << X; break;
-        case 0x0055: str << "LD    [I]   V" << X; break;
-        case 0x0065: str << "LD    V" << X <<"   [I]"; break;
-        } break;
+const char *getDecoderName(Decoder decoder)
+{
+    for (const auto &[decoderName, value] : kDecoderNames)
+    {
+        if (decoder == value)
+        {
+            return decoderName;
+        }
     }
+    return "unknown";
+}
 
-    return str.str();
+std::vector<std::string> findGames(const std::vector<std::string> &paths)
+{
+    std::vector<std::string> games;
+    for (const auto &path : paths)
+    {
+        if (std::filesystem::is_directory(path))
+        {
+            for (const auto &entry : std::filesystem::directory_iterator(path))
+            {
+                if (entry.path().extension() == ".ch8")
+                {
+                    games.push_back(entry.path().string());
+                }
+            }
+        }
+        else
+        {
+            games.push_back(path);
+        }
+    }
+    std::sort(games.begin(), games.end());
+    return games;
 }
 
 const Chip8State& Chip8::getState()
@@ -185,101 +312,619 @@ void Chip8::catchUp()
     auto elapsed = duration_cast<microseconds>(steady_clock::now() - startTime).count();
 
     // Execute as many instructions as needed to be up to date
-    auto instructionsShould = elapsed / instructionTime;
-    while (instructionsShould > instructionsExecuted && state.isRunning)
+    uint64_t instructionsShould = elapsed / instructionTime;
+
+    // Time spent waiting for a key isn't owed, otherwise the press would be followed by a burst
+    if (state.waitingForKey)
     {
-        emulateCycle();
-        instructionsExecuted++;
+        instructionsExecuted = std::max<uint64_t>(instructionsExecuted, instructionsShould);
+        return;
+    }
+
+    if (instructionsShould > instructionsExecuted)
+    {
+        instructionsExecuted += execute(instructionsShould - instructionsExecuted);
     }
 }
 
-int Chip8::executeMs(int ms)
+uint64_t Chip8::executeMs(int ms)
 {
     using namespace std::chrono;
 
-    startTime = steady_clock::now();
-    auto instructionsExecuted = 0;
+    const auto deadline = steady_clock::now() + milliseconds(ms);
+    uint64_t executed = 0;
+    uint64_t sinceClockCheck = 0;
 
-    // Execute as many instructions as possible in the given time
-    while (ms > duration_cast<milliseconds>(steady_clock::now() - startTime).count())
+    // Whole frames keep the timers ticking in emulated time, however fast the frames run
+    while (state.isRunning)
     {
-        emulateCycle();
-        instructionsExecuted++;
+        const auto frameInstructions = runFrame();
+        executed += frameInstructions;
+        sinceClockCheck += frameInstructions;
+
+        // Frames without instructions until a key gets pressed, the caller paces them instead
+        if (state.waitingForKey)
+        {
+            break;
+        }
+
+        // Reading the clock costs as much as a batch of instructions, so it's only done now and then
+        if (sinceClockCheck >= kClockCheckInterval)
+        {
+            if (steady_clock::now() >= deadline)
+            {
+                break;
+            }
+            sinceClockCheck = 0;
+        }
     }
 
-    return instructionsExecuted;
+    return executed;
+}
+
+uint64_t Chip8::execute(uint64_t count)
+{
+    if (inputQueue == nullptr)
+    {
+        return runBatch(count);
+    }
+
+    // Batches end at the next queued key change, so it applies in front of exactly its instruction
+    uint64_t executed = 0;
+    while (executed < count)
+    {
+        applyInput();
+
+        auto batch = count - executed;
+        if (const auto event = inputQueue->front())
+        {
+            batch = std::min(batch, event->instruction - state.instructionCount);
+        }
+
+        const auto ran = runBatch(batch);
+        executed += ran;
+        if (ran < batch)
+        {
+            break;
+        }
+    }
+
+    return executed;
+}
+
+uint64_t Chip8::runFrame()
+{
+    // The remainder carries over, so e.g. 500 instructions per second stay 500 instead of 8 * 60
+    const auto budget = state.instructionsPerSecond + frameRemainder;
+    frameRemainder = budget % kFramesPerSecond;
+
+    // Timers tick at the frame boundary in emulated time
+    const auto executed = execute(budget / kFramesPerSecond);
+    updateTimers();
+    return executed;
+}
+
+uint64_t Chip8::runBatch(uint64_t count)
+{
+    uint64_t executed = 0;
+
+    // Idle loops wait for a timer tick or a key change, neither can happen inside a batch
+    if (idleLoops[state.instructionPointer & 0xFFF])
+    {
+        executed = skipIdleLoop(count);
+    }
+
+#ifdef CHIP8_PROFILE
+    if (profiler)
+    {
+        executed += runProfiled(count - executed);
+    }
+    else
+#endif
+    // The threaded core keeps its registers in locals, so it runs whole batches
+    if (decoder == Decoder::Threaded)
+    {
+        executed += runThreaded(count - executed);
+    }
+    else if (decoder == Decoder::Jit && jit)
+    {
+        executed += runJit(count - executed);
+    }
+    else if (decoder == Decoder::Aot && aot)
+    {
+        executed += runAot(count - executed);
+    }
+    else if (decoder == Decoder::Cached)
+    {
+        executed += runCached(count - executed);
+    }
+    else
+    {
+        while (executed < count && state.isRunning && !state.waitingForKey)
+        {
+            executeInstruction();
+            executed++;
+        }
+    }
+
+    state.instructionCount += executed;
+    return executed;
+}
+
+#ifdef CHIP8_PROFILE
+uint64_t Chip8::runProfiled(uint64_t count)
+{
+    // Every instruction has to be seen by the profiler, so even block decoders run one at a time
+    uint64_t executed = 0;
+    while (executed < count && state.isRunning && !state.waitingForKey)
+    {
+        const auto address = state.instructionPointer;
+        const auto type = opcodeTable[state.memory[address & 0xFFF] << 8 | state.memory[(address + 1) & 0xFFF]];
+
+        const auto start = Profiler::readCycles();
+        executeInstruction();
+        profiler->record(type, address & 0xFFF, Profiler::readCycles() - start);
+        executed++;
+    }
+    return executed;
+}
+#endif
+
+uint64_t Chip8::skipIdleLoop(uint64_t count)
+{
+#ifdef CHIP8_PROFILE
+    // Every instruction has to be seen by the profiler
+    if (profiler)
+    {
+        return 0;
+    }
+#endif
+
+    // Delay timer polls (the DelayWait superinstruction) only end when the timer reads zero
+    for (int phase = 0; phase < 3; phase++)
+    {
+        const uint16_t start = state.instructionPointer - phase * sizeof(opcode);
+        if (fusions[start & 0xFFF].type == Superinstruction::DelayWait)
+        {
+            auto &timer = state.V[instructionCache[start & 0xFFF].x];
+            if (state.delayTimer == 0 || (phase == 1 && timer == 0) ||
+                std::find(state.breakpoints.begin(), state.breakpoints.end(), start) != state.breakpoints.end())
+            {
+                return 0;
+            }
+
+            // Every iteration loads the timer again
+            const auto skipped = count / 3 * 3;
+            timer = (skipped > 0) ? state.delayTimer : timer;
+            return skipped;
+        }
+    }
+
+    /**
+     * Other loops run through the interpreter until their registers repeat
+     * at the start address, once more if the first iteration still read a
+     * timer value from before the last tick. Idle instructions only change
+     * registers and the timers and keys they read stay the same within a
+     * batch, so from then on every iteration is the same. The remaining
+     * whole iterations are only counted, the rest runs normally.
+     */
+    const auto start = state.instructionPointer;
+    uint64_t executed = 0;
+
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+        const auto V = state.V;
+        const auto I = state.I;
+        const auto delayTimer = state.delayTimer;
+        const auto soundTimer = state.soundTimer;
+
+        uint64_t length = 0;
+        do
+        {
+            const auto address = state.instructionPointer & 0xFFF;
+            const auto type = opcodeTable[state.memory[address] << 8 | state.memory[(address + 1) & 0xFFF]];
+            if (executed == count || length == kMaxIdleLoopLength || !isIdleInstruction(type) || !state.isRunning)
+            {
+                return executed;
+            }
+
+            executeInstruction();
+            executed++;
+            length++;
+        } while (state.instructionPointer != start);
+
+        if (state.isRunning && state.V == V && state.I == I &&
+            state.delayTimer == delayTimer && state.soundTimer == soundTimer)
+        {
+            return executed + (count - executed) / length * length;
+        }
+    }
+
+    return executed;
 }
 
 void Chip8::emulateCycle()
 {
-    opcode = state.memory[state.instructionPointer] << 8 | state.memory[state.instructionPointer + 1];
+    executeInstruction();
+    state.instructionCount++;
+}
 
-    // Immediately increase instruction pointer. Simplifies the emulation methodes.
-    state.instructionPointer += sizeof(opcode);
+void Chip8::executeInstruction()
+{
+    if (decoder != Decoder::Switch && decoder != Decoder::Table)
+    {
+        // Operands are already unpacked, so there is nothing to fetch or decode
+        const auto op = fetchMicroOp(state.instructionPointer);
+        state.instructionPointer += sizeof(opcode);
+        (this->*handlers[static_cast<size_t>(op.type)])(op);
+    }
+    else
+    {
+        opcode = state.memory[state.instructionPointer] << 8 | state.memory[state.instructionPointer + 1];
+
+        // Immediately increase instruction pointer. Simplifies the emulation methodes.
+        state.instructionPointer += sizeof(opcode);
+
+        if (decoder == Decoder::Table)
+        {
+            dispatchTable();
+        }
+        else
+        {
+            dispatchSwitch();
+        }
+    }
+
+    // If the next instruction is a breakpoint we need to stop
+    if (std::find(state.breakpoints.begin(), state.breakpoints.end(), 
+                  state.instructionPointer) != state.breakpoints.end())
+    {
+        stop();
+    }
+}
+
+uint64_t Chip8::runJit(uint64_t count)
+{
+    uint64_t executed = 0;
+    while (executed < count && state.isRunning && !state.waitingForKey)
+    {
+        const auto address = state.instructionPointer;
+        auto block = jit->getBlock(address);
+
+        // Compile the block as soon as its start address gets hot
+        if (block == nullptr && jit->recordExecution(address))
+        {
+            block = jit->compile(state, address);
+        }
+
+        // Blocks may only run if they fit into the remaining instruction budget
+        if (block != nullptr && jit->getBlockLength(address) <= count - executed)
+        {
+            state.instructionPointer = block(&state, this);
+            executed += jit->getBlockLength(address);
+
+            // Blocks end in front of breakpoints, so only the exit has to be checked
+            if (!state.breakpoints.empty() &&
+                std::find(state.breakpoints.begin(), state.breakpoints.end(),
+                          state.instructionPointer) != state.breakpoints.end())
+            {
+                stop();
+            }
+        }
+        else
+        {
+            executeInstruction();
+            executed++;
+        }
+    }
+
+    return executed;
+}
+
+void Chip8::jitHelper(void *context, uint64_t op)
+{
+    // Instructions without native translation run through their interpreter handler
+    MicroOp microOp;
+    memcpy(static_cast<void *>(&microOp), &op, sizeof(microOp));
+
+    auto chip8 = static_cast<Chip8 *>(context);
+    (chip8->*handlers[static_cast<size_t>(microOp.type)])(microOp);
+}
+
+uint64_t Chip8::runAot(uint64_t count)
+{
+    const AotContext context{this, aotHelper};
+
+    uint64_t executed = 0;
+    while (executed < count && state.isRunning && !state.waitingForKey)
+    {
+        auto block = aot->getBlock(state.instructionPointer);
+
+        // The compiler didn't know about breakpoints, so they must not be inside the block
+        auto runnable = block != nullptr && block->length <= count - executed;
+        if (runnable && !state.breakpoints.empty())
+        {
+            runnable = std::none_of(state.breakpoints.begin(), state.breakpoints.end(),
+                                    [&](uint16_t address) { return address > block->start &&
+                                                                   address < block->end; });
+        }
+
+        if (runnable)
+        {
+            state.instructionPointer = block->function(state, context);
+            executed += block->length;
+
+            if (!state.breakpoints.empty() &&
+                std::find(state.breakpoints.begin(), state.breakpoints.end(),
+                          state.instructionPointer) != state.breakpoints.end())
+            {
+                stop();
+            }
+        }
+        else
+        {
+            executeInstruction();
+            executed++;
+        }
+    }
+
+    return executed;
+}
+
+void Chip8::loadAotProgram()
+{
+    aot.reset();
+    if (!state.game)
+    {
+        return;
+    }
+
+    auto module = AotProgram::find(state.memory.data() + state.kStartAddress, state.game->size);
+    if (module == nullptr)
+    {
+        std::cout << "Info: No ahead of time compiled code for this game, using cached decoder" << std::endl;
+        return;
+    }
+
+    aot = std::make_unique<AotProgram>(*module);
+}
+
+void Chip8::aotHelper(void *context, uint16_t opcode)
+{
+    // Complex instructions of compiled blocks run through their interpreter handler
+    const auto op = predecode(opcode);
+    auto chip8 = static_cast<Chip8 *>(context);
+    (chip8->*handlers[static_cast<size_t>(op.type)])(op);
+}
+
+void Chip8::dispatchSwitch()
+{
+    const MicroOp op{opcode};
 
     // Determine the right methode to call for the given opcode
     switch (opcode & 0xF000) {
     case 0x0000:
         switch (opcode & 0x000F) {
-        case 0x0000: CPU_00E0(); break;
-        case 0x000E: CPU_00EE(); break;
+        case 0x0000: CPU_00E0(op); break;
+        case 0x000E: CPU_00EE(op); break;
         } break;
-    case 0x1000: CPU_1NNN(); break;
-    case 0x2000: CPU_2NNN(); break;
-    case 0x3000: CPU_3XNN(); break;
-    case 0x4000: CPU_4XNN(); break;
-    case 0x5000: CPU_5XY0(); break;
-    case 0x6000: CPU_6XNN(); break;
-    case 0x7000: CPU_7XNN(); break;
+    case 0x1000: CPU_1NNN(op); break;
+    case 0x2000: CPU_2NNN(op); break;
+    case 0x3000: CPU_3XNN(op); break;
+    case 0x4000: CPU_4XNN(op); break;
+    case 0x5000: CPU_5XY0(op); break;
+    case 0x6000: CPU_6XNN(op); break;
+    case 0x7000: CPU_7XNN(op); break;
     case 0x8000:
         switch (opcode & 0x000F) {
-        case 0x0000: CPU_8XY0(); break;
-        case 0x0001: CPU_8XY1(); break;
-        case 0x0002: CPU_8XY2(); break;
-        case 0x0003: CPU_8XY3(); break;
-        case 0x0004: CPU_8XY4(); break;
-        case 0x0005: CPU_8XY5(); break;
-        case 0x0006: CPU_8XY6(); break;
-        case 0x0007: CPU_8XY7(); break;
-        case 0x000E: CPU_8XYE(); break;
+        case 0x0000: CPU_8XY0(op); break;
+        case 0x0001: CPU_8XY1(op); break;
+        case 0x0002: CPU_8XY2(op); break;
+        case 0x0003: CPU_8XY3(op); break;
+        case 0x0004: CPU_8XY4(op); break;
+        case 0x0005: CPU_8XY5(op); break;
+        case 0x0006: CPU_8XY6(op); break;
+        case 0x0007: CPU_8XY7(op); break;
+        case 0x000E: CPU_8XYE(op); break;
         } break;
-    case 0x9000: CPU_9XY0(); break;
-    case 0xA000: CPU_ANNN(); break;
-    case 0xB000: CPU_BNNN(); break;
-    case 0xC000: CPU_CXNN(); break;
-    case 0xD000: CPU_DXYN(); break;
+    case 0x9000: CPU_9XY0(op); break;
+    case 0xA000: CPU_ANNN(op); break;
+    case 0xB000: CPU_BNNN(op); break;
+    case 0xC000: CPU_CXNN(op); break;
+    case 0xD000: CPU_DXYN(op); break;
     case 0xE000:
         switch (opcode & 0x00FF) {
-        case 0x009E: CPU_EX9E(); break;
-        case 0x00A1: CPU_EXA1(); break;
+        case 0x009E: CPU_EX9E(op); break;
+        case 0x00A1: CPU_EXA1(op); break;
         } break;
     case 0xF000:
         switch (opcode & 0x00FF) {
-        case 0x0007: CPU_FX07(); break;
-        case 0x000A: CPU_FX0A(); break;
-        case 0x0015: CPU_FX15(); break;
-        case 0x0018: CPU_FX18(); break;
-        case 0x001E: CPU_FX1E(); break;
-        case 0x0029: CPU_FX29(); break;
-        case 0x0033: CPU_FX33(); break;
-        case 0x0055: CPU_FX55(); break;
-        case 0x0065: CPU_FX65(); break;
+        case 0x0007: CPU_FX07(op); break;
+        case 0x000A: CPU_FX0A(op); break;
+        case 0x0015: CPU_FX15(op); break;
+        case 0x0018: CPU_FX18(op); break;
+        case 0x001E: CPU_FX1E(op); break;
+        case 0x0029: CPU_FX29(op); break;
+        case 0x0033: CPU_FX33(op); break;
+        case 0x0055: CPU_FX55(op); break;
+        case 0x0065: CPU_FX65(op); break;
         } break;
     }
+}
 
-    // If the next instruction is a breakpoint we need to stop
-    if (std::find(state.breakpoints.begin(), state.breakpoints.end(), 
-                  state.instructionPointer) != state.breakpoints.end())
+MicroOp Chip8::fetchMicroOp(uint16_t address)
+{
+    auto &op = instructionCache[address & 0xFFF];
+
+    // Entries get decoded lazily after they have been invalidated by a memory write
+    if (!op.valid)
     {
-        stop();
+        op = predecode(state.memory[address & 0xFFF] << 8 | state.memory[(address + 1) & 0xFFF]);
     }
+
+    return op;
+}
+
+void Chip8::findIdleLoops()
+{
+    // Short loops of idle instructions which end with a jump back to their start
+    idleLoops.reset();
+    const int end = state.kStartAddress + state.game->size;
+    for (int jump = state.kStartAddress; jump + 1 < end; jump++)
+    {
+        const uint16_t opcode = state.memory[jump] << 8 | state.memory[jump + 1];
+        const int target = opcode & 0x0FFF;
+        if (opcodeTable[opcode] != Opcode::CPU_1NNN || target > jump || (jump - target) % 2 != 0 ||
+            (jump - target) / 2 >= kMaxIdleLoopLength)
+        {
+            continue;
+        }
+
+        auto idle = true;
+        for (int address = target; address < jump && idle; address += 2)
+        {
+            idle = isIdleInstruction(opcodeTable[state.memory[address] << 8 | state.memory[address + 1]]);
+        }
+
+        for (int address = target; address <= jump && idle; address += 2)
+        {
+            idleLoops.set(address);
+        }
+    }
+}
+
+void Chip8::analyzeControlFlow()
+{
+    // A new graph instead of rebuilding the old one, views of other threads may still use that
+    auto graph = std::make_shared<ControlFlowGraph>();
+    if (state.game)
+    {
+        graph->build(state.memory, state.kStartAddress, state.kStartAddress + state.game->size);
+    }
+    state.controlFlow = std::move(graph);
+}
+
+void Chip8::predecodeInstructions()
+{
+    // Everything outside of the game gets decoded on first use
+    instructionCache.fill(MicroOp{});
+
+    // Decode every address of the game, odd ones as well for misaligned jumps
+    const int end = state.kStartAddress + state.game->size;
+    for (int i = state.kStartAddress; i < end; i++)
+    {
+        fetchMicroOp(i);
+    }
+}
+
+void Chip8::invalidateInstructions(uint16_t address, uint16_t length)
+{
+    if (jit)
+    {
+        jit->invalidate(address, length);
+    }
+
+    if (aot)
+    {
+        aot->invalidate(address, length);
+    }
+
+    // The instruction one byte in front of the write covers the first written byte too
+    for (int i = address - 1; i < address + length; i++)
+    {
+        instructionCache[i & 0xFFF].valid = false;
+    }
+
+    // Drop every superinstruction which contains one of the written bytes
+    const int kMaxFusionBytes = kMaxLoadRun * sizeof(opcode);
+    for (int i = address - kMaxFusionBytes + 1; i < address + length; i++)
+    {
+        auto &fusion = fusions[i & 0xFFF];
+        if (fusion.type != Superinstruction::None && i + fusion.length * 2 > address)
+        {
+            fusion = Fusion{};
+        }
+    }
+}
+
+void Chip8::dispatchTable()
+{
+    // One lookup for the instruction class and one indirect call to its handler
+    (this->*handlers[static_cast<size_t>(opcodeTable[opcode])])(MicroOp{opcode});
 }
 
 void Chip8::setButton(bool pressed, int index)
 {
+    if (movie != nullptr)
+    {
+        movie->recordButton(state, pressed, index);
+    }
     state.keypad[index] = pressed;
+
+    // A press ends the wait of FX0A, checked like any other step onto the next instruction
+    if (pressed && state.waitingForKey)
+    {
+        state.V[state.keyRegister] = index;
+        state.waitingForKey = false;
+        state.instructionPointer += sizeof(opcode);
+
+        if (std::find(state.breakpoints.begin(), state.breakpoints.end(),
+                      state.instructionPointer) != state.breakpoints.end())
+        {
+            stop();
+        }
+    }
+}
+
+void Chip8::setInputQueue(InputQueue *queue)
+{
+    inputQueue = queue;
 }
 
+void Chip8::applyInput()
+{
+    if (inputQueue == nullptr)
+    {
+        return;
+    }
+
+    // Parked on FX0A the instruction count doesn't move, so the next change is due right away whatever its stamp
+    for (auto event = inputQueue->front();
+         event != nullptr && (event->instruction <= state.instructionCount || state.waitingForKey);
+         event = inputQueue->front())
+    {
+        setButton(event->pressed, event->key & 0xF);
+        inputQueue->pop();
+    }
+}
+
+void Chip8::flushInput()
+{
+    if (inputQueue == nullptr)
+    {
+        return;
+    }
+
+    // The stamps belong to the instruction count before a load, so everything applies right away
+    for (auto event = inputQueue->front(); event != nullptr; event = inputQueue->front())
+    {
+        setButton(event->pressed, event->key & 0xF);
+        inputQueue->pop();
+    }
+}
+
+void Chip8::setMovie(InputMovie *movie)
+{
+    this->movie = movie;
+}
+
+#ifdef CHIP8_PROFILE
+void Chip8::setProfiler(Profiler *profiler)
+{
+    this->profiler = profiler;
+}
+#endif
+
 void Chip8::updateTimers()
 {
     if (state.isRunning)
@@ -293,9 +938,25 @@ void Chip8::updateTimers()
         {
             state.soundTimer--;
         }
+
+        if (movie != nullptr)
+        {
+            movie->recordFrame(state);
+        }
     }
 }
 
+uint32_t Chip8::nextRandom()
+{
+    // Xorshift32, the state is part of the machine, so runs are reproducible and instances independent
+    auto value = state.random;
+    value ^= value << 13;
+    value ^= value >> 17;
+    value ^= value << 5;
+    state.random = value;
+    return value;
+}
+
 void Chip8::increaseSpeed()
 {
     state.instructionsPerSecond += kSpeedStepSize;
@@ -329,91 +990,195 @@ void Chip8::toggleBreakpoint()
                                             state.instructionPointer), 
                                             state.breakpoints.end());
     }
+
+    // Compiled blocks only know about the breakpoints they were compiled with
+    if (jit)
+    {
+        jit->flush();
+    }
+
+    // Superinstructions must not hide a breakpoint either
+    fuseInstructions();
 }
 
-void Chip8::CPU_00E0()
+void Chip8::saveState(MachineState &snapshot) const
 {
-    state.display.fill(false);
+    snapshot = state;
 }
 
-void Chip8::CPU_00EE()
+void Chip8::loadState(const MachineState &snapshot)
+{
+    // Instructions only have to be decoded again where the code differs from the snapshot
+    const int kBlockSize = 64;
+    const int gameEnd = state.kStartAddress + (state.game ? state.game->size : 0);
+    auto gameChanged = false;
+    for (int address = 0; address < static_cast<int>(state.memory.size()); address += kBlockSize)
+    {
+        if (memcmp(state.memory.data() + address, snapshot.memory.data() + address, kBlockSize) != 0)
+        {
+            invalidateInstructions(address, kBlockSize);
+            gameChanged |= address + kBlockSize > state.kStartAddress && address < gameEnd;
+        }
+    }
+
+    static_cast<MachineState &>(state) = snapshot;
+    flushInput();
+
+    if (gameChanged)
+    {
+        analyzeControlFlow();
+    }
+
+    // Pacing starts over from the loaded state instead of catching up on the time before
+    resetTime();
+    frameRemainder = 0;
+}
+
+bool Chip8::saveStateFile(const std::string &path) const
+{
+    if (!SaveStateFile::write(path, state, state.game ? state.game->name : ""))
+    {
+        return false;
+    }
+
+    std::cout << "Info: Current state saved to " << path << std::endl;
+    return true;
+}
+
+bool Chip8::loadStateFile(const std::string &path)
+{
+    SaveStateFile stateFile;
+    if (!stateFile.open(path))
+    {
+        return false;
+    }
+
+    loadState(*stateFile.getState());
+    return true;
+}
+
+void Chip8::setDecoder(Decoder decoder)
+{
+    this->decoder = decoder;
+
+    if (decoder == Decoder::Jit && !jit)
+    {
+        if (JitCompiler::isSupported())
+        {
+            jit = std::make_unique<JitCompiler>(jitHelper, this);
+        }
+        else
+        {
+            std::cout << "Info: JIT not supported on this platform, using cached decoder" << std::endl;
+        }
+    }
+
+    if (decoder == Decoder::Aot && !aot)
+    {
+        loadAotProgram();
+    }
+}
+
+Decoder Chip8::getDecoder() const
+{
+    return decoder;
+}
+
+void Chip8::setSeed(uint32_t seed)
+{
+    // Xorshift never leaves zero
+    this->seed = (seed != 0) ? seed : 1;
+    state.random = this->seed;
+}
+
+void Chip8::CPU_INVALID([[maybe_unused]] const MicroOp &op)
+{
+    // Unknown opcodes get ignored, just like in the switch decoder
+}
+
+void Chip8::CPU_00E0([[maybe_unused]] const MicroOp &op)
+{
+    state.display.fill(0);
+}
+
+void Chip8::CPU_00EE([[maybe_unused]] const MicroOp &op)
 {
     state.stackPointer--;
     state.instructionPointer = state.stack[state.stackPointer];
 }
 
-void Chip8::CPU_1NNN()
+void Chip8::CPU_1NNN(const MicroOp &op)
 {
     state.instructionPointer = NNN;
 }
 
-void Chip8::CPU_2NNN()
+void Chip8::CPU_2NNN(const MicroOp &op)
 {
     state.stack[state.stackPointer] = state.instructionPointer;
     state.stackPointer++;
     state.instructionPointer = NNN;
 }
 
-void Chip8::CPU_3XNN()
+void Chip8::CPU_3XNN(const MicroOp &op)
 {
     state.instructionPointer += (VX == NN) ? sizeof(opcode) : 0;
 }
 
-void Chip8::CPU_4XNN()
+void Chip8::CPU_4XNN(const MicroOp &op)
 {
     state.instructionPointer += (VX != NN) ? sizeof(opcode) : 0;
 }
 
-void Chip8::CPU_5XY0()
+void Chip8::CPU_5XY0(const MicroOp &op)
 {
     state.instructionPointer += (VX == VY) ? sizeof(opcode) : 0;
 }
 
-void Chip8::CPU_6XNN()
+void Chip8::CPU_6XNN(const MicroOp &op)
 {
     VX = NN;
 }
 
-void Chip8::CPU_7XNN()
+void Chip8::CPU_7XNN(const MicroOp &op)
 {
     VX += NN;
 }
 
-void Chip8::CPU_8XY0()
+void Chip8::CPU_8XY0(const MicroOp &op)
 {
     VX = VY;
 }
 
-void Chip8::CPU_8XY1()
+void Chip8::CPU_8XY1(const MicroOp &op)
 {
     VX |= VY;
 }
 
-void Chip8::CPU_8XY2()
+void Chip8::CPU_8XY2(const MicroOp &op)
 {
     VX &= VY;
 }
 
-void Chip8::CPU_8XY3()
+void Chip8::CPU_8XY3(const MicroOp &op)
 {
     VX ^= VY;
 }
 
-void Chip8::CPU_8XY4()
+void Chip8::CPU_8XY4(const MicroOp &op)
 {
     // First check if an overflow will occur
     state.V[0xF] = (VY > (0xFF - VX)) ? 1 : 0;
     VX += VY;
 }
 
-void Chip8::CPU_8XY5()
+void Chip8::CPU_8XY5(const MicroOp &op)
 {
     // First check if an underflow will occur
     state.V[0xF] = (VY > VX) ? 0 : 1;
     VX -= VY;
 }
 
-void Chip8::CPU_8XY6()
+void Chip8::CPU_8XY6(const MicroOp &op)
 {
     // Set VF to the lsb of VX
     state.V[0xF] = VX & 0x1;
@@ -426,14 +1191,14 @@ void Chip8::CPU_8XY6()
      */
 }
 
-void Chip8::CPU_8XY7()
+void Chip8::CPU_8XY7(const MicroOp &op)
 {
     // First check if an underflow will occur
     state.V[0xF] = (VX > VY) ? 0 : 1;
     VX = VY - VX;
 }
 
-void Chip8::CPU_8XYE()
+void Chip8::CPU_8XYE(const MicroOp &op)
 {
     // Set VF to the msb of VX
     state.V[0xF] = VX >> 7;
@@ -446,88 +1211,68 @@ void Chip8::CPU_8XYE()
      */
 }
 
-void Chip8::CPU_9XY0()
+void Chip8::CPU_9XY0(const MicroOp &op)
 {
     state.instructionPointer += (VX != VY) ? sizeof(opcode) : 0;
 }
 
-void Chip8::CPU_ANNN()
+void Chip8::CPU_ANNN(const MicroOp &op)
 {
     state.I = NNN;
 }
 
-void Chip8::CPU_BNNN()
+void Chip8::CPU_BNNN(const MicroOp &op)
 {
     state.instructionPointer = NNN + state.V[0];
 }
 
-void Chip8::CPU_CXNN()
+void Chip8::CPU_CXNN(const MicroOp &op)
 {
     // Set VX to a random number masked with NN
-    VX = NN & (rand() % 0xFF);
+    VX = NN & (nextRandom() % 0xFF);
 }
 
-void Chip8::CPU_DXYN()
+void Chip8::CPU_DXYN(const MicroOp &op)
 {
-    // Destination of sprite on display
-    uint8_t xDest = VX; // Wrap around feature % state.kHorizontalRes;
-    uint8_t yDest = VY; // Wrap around feature % state.kVerticalRes;
-
-    // Width and hight of the sprite
-    uint8_t spriteHeight = N;
-    const uint8_t KSpriteWidth = 8;
-
-    // Clean collision flag
-    state.V[0xF] = 0;
+    // Destination of sprite on display, sprites which cross the edges get clipped
+    uint8_t xDest = VX % state.kHorizontalRes;
+    uint8_t yDest = VY % state.kVerticalRes;
+    int spriteHeight = std::min<int>(N, state.kVerticalRes - yDest);
 
+    // Move every sprite row to its horizontal position, pixels right of the edge fall out
+    std::array<uint64_t, 16> spriteRows;
     for (int y = 0; y < spriteHeight; y++)
     {
-        // Get bits of the current sprite row
-        uint8_t spriteRowBits = state.memory[state.I + y];
-
-        for (int x = 0; x < KSpriteWidth; x++)
-        {
-            // Walk through the sprite row bits and check if one is set
-            if ((spriteRowBits & (0x80 >> x)) != 0)
-            {
-                // Determine the position in the display array
-                auto pixel = (((yDest + y) * state.kHorizontalRes) + xDest + x);
-
-                if (state.display[pixel])
-                {
-                    // If ANY pixel gets changed from 1 to 0 we have a collision
-                    state.V[0xF] |= 1;
-                }
-
-                // XOR display pixel with sprite bit
-                state.display[pixel] ^= true;
-            }
-        }
+        uint64_t spriteRowBits = state.memory[(state.I + y) & 0xFFF];
+        spriteRows[y] = (spriteRowBits << (state.kHorizontalRes - 8)) >> xDest;
     }
+
+    // If ANY pixel gets changed from 1 to 0 we have a collision
+    state.V[0xF] = xorSpriteRows(state.display.data() + yDest, spriteRows.data(), spriteHeight) ? 1 : 0;
 }
 
-void Chip8::CPU_EX9E()
+void Chip8::CPU_EX9E(const MicroOp &op)
 {
     state.instructionPointer += state.keypad[VX] ? sizeof(opcode) : 0;
 }
 
-void Chip8::CPU_EXA1()
+void Chip8::CPU_EXA1(const MicroOp &op)
 {
     state.instructionPointer += !(state.keypad[VX]) ? sizeof(opcode) : 0;
 }
 
-void Chip8::CPU_FX07()
+void Chip8::CPU_FX07(const MicroOp &op)
 {
     VX = state.delayTimer;
 }
 
-void Chip8::CPU_FX0A()
+void Chip8::CPU_FX0A(const MicroOp &op)
 {
     /**
-     * Normally this is a blocking operation but because we only work with
-     * one thread the application would get unresponsive if we block here.
-     * As a workaround the instruction pointer gets modified so we only 
-     * move to the next opcode after a key has been pressed.
+     * A key which is already held completes the instruction right away.
+     * Otherwise the machine parks on it: nothing gets executed anymore and
+     * only the timers keep ticking until setButton() reports a press, which
+     * stores the key and moves on to the next instruction.
      */
     auto keyPressed = false;
     for (int i = 0; i < state.keypad.size(); i++)
@@ -542,44 +1287,50 @@ void Chip8::CPU_FX0A()
     if (!keyPressed)
     {
         state.instructionPointer -= sizeof(opcode);
+        state.waitingForKey = true;
+        state.keyRegister = op.x;
     }
 }
 
-void Chip8::CPU_FX15()
+void Chip8::CPU_FX15(const MicroOp &op)
 {
     state.delayTimer = VX;
 }
 
-void Chip8::CPU_FX18()
+void Chip8::CPU_FX18(const MicroOp &op)
 {
     state.soundTimer = VX;
 }
 
-void Chip8::CPU_FX1E()
+void Chip8::CPU_FX1E(const MicroOp &op)
 {
     // First check if I will be bigger than 0xFFF afterwards
     state.V[0xF] = (state.I + VX > 0xFFF) ? 1 : 0;
     state.I += VX;
 }
 
-void Chip8::CPU_FX29()
+void Chip8::CPU_FX29(const MicroOp &op)
 {
     // Set I to the address of the fontset sprite representing the VX value
     state.I = VX * 0x5;
 }
 
-void Chip8::CPU_FX33()
+void Chip8::CPU_FX33(const MicroOp &op)
 {
     // Store binary coded decimal of VX value in I, I+1, I+2
     state.memory[state.I] = VX / 100;            // First digit of VX value
     state.memory[state.I + 1] = (VX / 10) % 10;  // Mid digit
     state.memory[state.I + 2] = (VX % 100) % 10; // Last digit
+
+    // Self-modifying code: decode the overwritten instructions again
+    invalidateInstructions(state.I, 3);
 }
 
-void Chip8::CPU_FX55()
+void Chip8::CPU_FX55(const MicroOp &op)
 {
     // Store V0 to VX in memory starting at I
     memcpy(state.memory.data() + state.I, state.V.data(), X + 1);
+    invalidateInstructions(state.I, X + 1);
 
     /**
      * Alternative implementation (used by some games)
@@ -587,7 +1338,7 @@ void Chip8::CPU_FX55()
      */
 }
 
-void Chip8::CPU_FX65()
+void Chip8::CPU_FX65(const MicroOp &op)
 {
     // Load V0 to VX with values in memory starting at I
     memcpy(state.V.data(), state.memory.data() + state.I, X + 1);
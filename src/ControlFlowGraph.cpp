@@ -0,0 +1,367 @@
+//--------------------------------------------------------------------------------------------------
+// Cross-Platform Chip-8 Emulator
+// Copyright (C) 2020 Enrico Schörnick
+// Licensed under the MIT License
+//--------------------------------------------------------------------------------------------------
+
+#include "chip8/ControlFlowGraph.hpp"
+#include "chip8/Opcode.hpp"
+#include "chip8/Disassembler.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+
+namespace
+{
+    bool isSkip(Opcode type)
+    {
+        return type == Opcode::CPU_3XNN || type == Opcode::CPU_4XNN || type == Opcode::CPU_5XY0 ||
+               type == Opcode::CPU_9XY0 || type == Opcode::CPU_EX9E || type == Opcode::CPU_EXA1;
+    }
+
+    // Instructions after which execution doesn't simply continue with the next one
+    bool endsBlock(Opcode type)
+    {
+        return isSkip(type) || type == Opcode::CPU_00EE || type == Opcode::CPU_1NNN || type == Opcode::CPU_2NNN ||
+               type == Opcode::CPU_BNNN;
+    }
+}
+
+void ControlFlowGraph::build(const std::array<uint8_t, 4096> &memory, uint16_t start, uint16_t end)
+{
+    this->memory = memory;
+    this->start = start;
+    this->end = std::min<uint16_t>(end, static_cast<uint16_t>(memory.size()));
+
+    blocks.clear();
+    functions.clear();
+    issues.clear();
+    instructions.reset();
+    leaders.reset();
+    code.reset();
+
+    if (isInGame(start))
+    {
+        findInstructions();
+        createBlocks();
+        assignFunctions();
+    }
+}
+
+const std::vector<BasicBlock> &ControlFlowGraph::getBlocks() const
+{
+    return blocks;
+}
+
+const std::vector<uint16_t> &ControlFlowGraph::getFunctions() const
+{
+    return functions;
+}
+
+const std::vector<CodeIssue> &ControlFlowGraph::getIssues() const
+{
+    return issues;
+}
+
+bool ControlFlowGraph::isCode(uint16_t address) const
+{
+    return code[address & 0xFFF];
+}
+
+bool ControlFlowGraph::isInstruction(uint16_t address) const
+{
+    return instructions[address & 0xFFF];
+}
+
+bool ControlFlowGraph::isFunction(uint16_t address) const
+{
+    return std::binary_search(functions.begin(), functions.end(), address);
+}
+
+Disassembler::Role ControlFlowGraph::getRole(uint16_t address) const
+{
+    // Nothing is known about memory outside of the game, code may be written there at runtime
+    if (address < start || address >= end)
+    {
+        return Disassembler::Role::Code;
+    }
+
+    if (isInstruction(address))
+    {
+        return isFunction(address) ? Disassembler::Role::Subroutine : Disassembler::Role::Code;
+    }
+
+    // Bytes inside an instruction of the other stream still get decoded, they are executed after all
+    if (isCode(address))
+    {
+        return Disassembler::Role::Code;
+    }
+    return isInstruction(address + 1) ? Disassembler::Role::Byte : Disassembler::Role::Data;
+}
+
+size_t ControlFlowGraph::getCodeSize() const
+{
+    return code.count();
+}
+
+const BasicBlock *ControlFlowGraph::findBlock(uint16_t address) const
+{
+    // Blocks of a misaligned stream can overlap the ones of the aligned stream, so the parity has to match too
+    const auto block = std::find_if(blocks.begin(), blocks.end(), [&](const BasicBlock &block) {
+        return address >= block.start && address < block.end && (address - block.start) % 2 == 0;
+    });
+    return (block != blocks.end()) ? &*block : nullptr;
+}
+
+const char *ControlFlowGraph::getIssueName(CodeIssue::Type type)
+{
+    switch (type) {
+    case CodeIssue::InvalidOpcode: return "invalid opcode";
+    case CodeIssue::TargetOutOfRange: return "target outside of the game";
+    case CodeIssue::RunsOffEnd: return "runs off the end of the game";
+    case CodeIssue::IndirectJump: return "indirect jump";
+    }
+    return "unknown";
+}
+
+uint16_t ControlFlowGraph::getOpcode(uint16_t address) const
+{
+    return memory[address & 0xFFF] << 8 | memory[(address + 1) & 0xFFF];
+}
+
+bool ControlFlowGraph::isInGame(uint16_t address) const
+{
+    // Both bytes of the instruction have to belong to the game
+    return address >= start && address + 1 < end;
+}
+
+void ControlFlowGraph::findInstructions()
+{
+    std::vector<uint16_t> pending{start};
+    functions.push_back(start);
+    leaders.set(start);
+
+    auto addNext = [&](uint16_t from, uint16_t next, bool startsBlock) {
+        if (!isInGame(next))
+        {
+            issues.push_back(CodeIssue{CodeIssue::RunsOffEnd, from});
+            return;
+        }
+        leaders[next] = leaders[next] || startsBlock;
+        pending.push_back(next);
+    };
+
+    auto addTarget = [&](uint16_t from, uint16_t target) {
+        if (!isInGame(target))
+        {
+            issues.push_back(CodeIssue{CodeIssue::TargetOutOfRange, from});
+            return false;
+        }
+        leaders.set(target);
+        pending.push_back(target);
+        return true;
+    };
+
+    while (!pending.empty())
+    {
+        const auto address = pending.back();
+        pending.pop_back();
+        if (instructions[address])
+        {
+            continue;
+        }
+
+        instructions.set(address);
+        code.set(address);
+        code.set(address + 1);
+
+        const auto opcode = getOpcode(address);
+        const auto type = decodeOpcode(opcode);
+        const uint16_t target = opcode & 0x0FFF;
+
+        if (type == Opcode::CPU_BNNN)
+        {
+            issues.push_back(CodeIssue{CodeIssue::IndirectJump, address});
+        }
+        else if (type == Opcode::CPU_1NNN)
+        {
+            addTarget(address, target);
+        }
+        else if (type == Opcode::CPU_2NNN)
+        {
+            if (addTarget(address, target) && std::find(functions.begin(), functions.end(), target) == functions.end())
+            {
+                functions.push_back(target);
+            }
+            addNext(address, address + 2, true);
+        }
+        else if (isSkip(type))
+        {
+            addNext(address, address + 2, true);
+            addNext(address, address + 4, true);
+        }
+        else if (type != Opcode::CPU_00EE)
+        {
+            // The emulator ignores unknown opcodes, so they get reported but execution continues
+            if (type == Opcode::Invalid)
+            {
+                issues.push_back(CodeIssue{CodeIssue::InvalidOpcode, address});
+            }
+            addNext(address, address + 2, false);
+        }
+    }
+
+    std::sort(functions.begin(), functions.end());
+    std::sort(issues.begin(), issues.end(),
+              [](const CodeIssue &a, const CodeIssue &b) { return a.address < b.address; });
+}
+
+void ControlFlowGraph::createBlocks()
+{
+    for (uint16_t leader = start; leader < end; leader++)
+    {
+        if (!leaders[leader] || !instructions[leader])
+        {
+            continue;
+        }
+
+        BasicBlock block{leader, leader, 0, {}, 0};
+        for (auto address = leader;; address += 2)
+        {
+            const auto opcode = getOpcode(address);
+            const auto type = decodeOpcode(opcode);
+            block.end = address + 2;
+
+            if (endsBlock(type))
+            {
+                const uint16_t target = opcode & 0x0FFF;
+                if (type == Opcode::CPU_1NNN && isInGame(target))
+                {
+                    block.successors.push_back(target);
+                }
+                else if (type == Opcode::CPU_2NNN)
+                {
+                    block.callee = isInGame(target) ? target : 0;
+                    if (isInGame(address + 2))
+                    {
+                        block.successors.push_back(address + 2);
+                    }
+                }
+                else if (isSkip(type))
+                {
+                    for (const uint16_t next : {address + 2, address + 4})
+                    {
+                        if (isInGame(next))
+                        {
+                            block.successors.push_back(next);
+                        }
+                    }
+                }
+                break;
+            }
+
+            // Falling into another block or off the end of the game
+            const uint16_t next = address + 2;
+            if (!isInGame(next) || !instructions[next])
+            {
+                break;
+            }
+            if (leaders[next])
+            {
+                block.successors.push_back(next);
+                break;
+            }
+        }
+
+        blocks.push_back(std::move(block));
+    }
+}
+
+void ControlFlowGraph::assignFunctions()
+{
+    std::vector<bool> assigned(blocks.size(), false);
+
+    // Blocks reachable from more than one subroutine belong to the one with the lowest address
+    for (const auto function : functions)
+    {
+        std::vector<uint16_t> pending{function};
+        while (!pending.empty())
+        {
+            const auto address = pending.back();
+            pending.pop_back();
+
+            const auto block = std::lower_bound(blocks.begin(), blocks.end(), address,
+                                                [](const BasicBlock &block, uint16_t address) {
+                                                    return block.start < address;
+                                                });
+            if (block == blocks.end() || block->start != address || assigned[block - blocks.begin()])
+            {
+                continue;
+            }
+
+            assigned[block - blocks.begin()] = true;
+            block->function = function;
+            pending.insert(pending.end(), block->successors.begin(), block->successors.end());
+        }
+    }
+}
+
+bool ControlFlowGraph::saveDot(const std::string &path, const std::string &name) const
+{
+    std::ofstream file(path);
+    if (!file.is_open())
+    {
+        std::cout << "Error: Couldn't open " << path << std::endl;
+        return false;
+    }
+
+    file << std::hex << "digraph \"" << name << "\" {\n"
+         << "  node [shape=box, fontname=\"monospace\"];\n";
+
+    char line[Disassembler::kLineSize];
+    for (const auto function : functions)
+    {
+        file << "  subgraph cluster_" << function << " {\n"
+             << "    label=\"" << ((function == start) ? "start " : "sub ") << function << "\";\n";
+
+        for (const auto &block : blocks)
+        {
+            if (block.function != function)
+            {
+                continue;
+            }
+
+            auto hasIssue = false;
+            file << "    b" << block.start << " [label=\"";
+            for (auto address = block.start; address < block.end; address += 2)
+            {
+                file << std::string_view(line, Disassembler::format(line, address, getOpcode(address))) << "\\l";
+                hasIssue |= std::any_of(issues.begin(), issues.end(),
+                                        [&](const CodeIssue &issue) { return issue.address == address; });
+            }
+            file << "\"" << (hasIssue ? ", color=red" : "") << "];\n";
+        }
+        file << "  }\n";
+    }
+
+    for (const auto &block : blocks)
+    {
+        for (const auto successor : block.successors)
+        {
+            file << "  b" << block.start << " -> b" << successor << ";\n";
+        }
+        if (block.callee != 0)
+        {
+            file << "  b" << block.start << " -> b" << block.callee << " [style=dashed];\n";
+        }
+    }
+    file << "}\n";
+
+    if (!file)
+    {
+        std::cout << "Error: Couldn't write " << path << std::endl;
+        return false;
+    }
+    return true;
+}
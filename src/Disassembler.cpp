@@ -0,0 +1,115 @@
+//--------------------------------------------------------------------------------------------------
+// Cross-Platform Chip-8 Emulator
+// Copyright (C) 2020 Enrico Schörnick
+// Licensed under the MIT License
+//--------------------------------------------------------------------------------------------------
+
+#include "chip8/Disassembler.hpp"
+
+#include <charconv>
+
+namespace
+{
+    /**
+     * Line templates of all instruction classes, indexed by the Opcode enum.
+     * Operands: %x and %y registers, %n nibble, %b byte, %h high byte, %a address, %w opcode.
+     */
+    constexpr std::array<const char *, kOpcodeCount> kFormats{
+        "DW    #%w",
+        "CLS",
+        "RET",
+        "JP    #%a",
+        "CALL  #%a",
+        "SE    V%x   #%b",
+        "SNE   V%x   #%b",
+        "SE    V%x   V%y",
+        "LD    V%x   #%b",
+        "ADD   V%x   #%b",
+        "LD    V%x   V%y",
+        "OR    V%x   V%y",
+        "AND   V%x   V%y",
+        "XOR   V%x   V%y",
+        "ADD   V%x   V%y",
+        "SUB   V%x   V%y",
+        "SHR   V%x",
+        "SUBN  V%x   V%y",
+        "SHL   V%x",
+        "SNE   V%x   V%y",
+        "LD    I    #%a",
+        "JP    V0   #%a",
+        "RND   V%x   #%b",
+        "DRW   V%x   V%y   #%n",
+        "SKP   V%x",
+        "SKNP  V%x",
+        "LD    V%x   DT",
+        "LD    V%x   K",
+        "LD    DT   V%x",
+        "LD    ST   V%x",
+        "ADD   I    V%x",
+        "LD    F    V%x",
+        "BCD   V%x",
+        "LD    [I]   V%x",
+        "LD    V%x   [I]"};
+
+    // Data lines, indexed by Role::Data and Role::Byte
+    constexpr const char *kDataFormats[] = {"DB    #%h   #%b", "DB    #%h"};
+
+    constexpr unsigned getOperand(char operand, uint16_t opcode)
+    {
+        switch (operand) {
+        case 'x': return (opcode & 0x0F00) >> 8;
+        case 'y': return (opcode & 0x00F0) >> 4;
+        case 'n': return opcode & 0x000F;
+        case 'h': return opcode >> 8;
+        case 'b': return opcode & 0x00FF;
+        case 'a': return opcode & 0x0FFF;
+        }
+        return opcode;
+    }
+}
+
+size_t Disassembler::format(char *buffer, uint16_t address, uint16_t opcode, Role role)
+{
+    const auto end = buffer + kLineSize;
+    auto out = std::to_chars(buffer, end, address, 16).ptr;
+    *out++ = ' ';
+    *out++ = (role == Role::Subroutine) ? ':' : '-';
+    *out++ = ' ';
+
+    const auto isData = role == Role::Data || role == Role::Byte;
+    const auto line = isData ? kDataFormats[role == Role::Byte] : kFormats[static_cast<size_t>(decodeOpcode(opcode))];
+    for (auto text = line; *text != '\0'; text++)
+    {
+        if (*text == '%')
+        {
+            out = std::to_chars(out, end, getOperand(*++text, opcode), 16).ptr;
+        }
+        else
+        {
+            *out++ = *text;
+        }
+    }
+
+    return out - buffer;
+}
+
+std::string_view Disassembler::getLine(const std::array<uint8_t, 4096> &memory, uint16_t address, Role role)
+{
+    address &= 0xFFF;
+    const uint16_t opcode = memory[address] << 8 | memory[(address + 1) & 0xFFF];
+    const auto line = arena.data() + address * kLineSize;
+
+    if (lengths[address] == 0 || opcodes[address] != opcode || roles[address] != role)
+    {
+        opcodes[address] = opcode;
+        roles[address] = role;
+        lengths[address] = static_cast<uint8_t>(format(line, address, opcode, role));
+    }
+
+    return std::string_view(line, lengths[address]);
+}
+
+void Disassembler::clear()
+{
+    lengths.fill(0);
+}
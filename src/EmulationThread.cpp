@@ -0,0 +1,240 @@
+//--------------------------------------------------------------------------------------------------
+// Cross-Platform Chip-8 Emulator
+// Copyright (C) 2020 Enrico Schörnick
+// Licensed under the MIT License
+//--------------------------------------------------------------------------------------------------
+
+#include "chip8/EmulationThread.hpp"
+
+EmulationThread::EmulationThread(Chip8 &chip8) : chip8{chip8}
+{
+    chip8.setInputQueue(&inputQueue);
+
+    // The view starts with the state the game was loaded with
+    publishFrame();
+    publishRegisters();
+    publishDebugInfo();
+}
+
+EmulationThread::~EmulationThread()
+{
+    stop();
+    chip8.setInputQueue(nullptr);
+}
+
+void EmulationThread::start()
+{
+    if (!thread.joinable())
+    {
+        quit = false;
+        thread = std::thread(&EmulationThread::run, this);
+    }
+}
+
+void EmulationThread::stop()
+{
+    if (thread.joinable())
+    {
+        quit = true;
+        thread.join();
+    }
+}
+
+void EmulationThread::post(Command command, bool changesDebugInfo)
+{
+    std::lock_guard<std::mutex> lock(commandMutex);
+    commands.emplace_back(std::move(command), changesDebugInfo);
+}
+
+void EmulationThread::setWarpMode(bool enabled)
+{
+    post([this, enabled](Chip8 &chip8) {
+        warpMode = enabled;
+        reportInstructions = instructions;
+        reportTime = std::chrono::steady_clock::now();
+
+        // Pacing starts over after warping, otherwise the scheduler would wait for the skipped time
+        scheduler.reset();
+        if (enabled)
+        {
+            chip8.start();
+        }
+    });
+}
+
+void EmulationThread::setMovie(InputMovie *movie)
+{
+    post([movie](Chip8 &chip8) { chip8.setMovie(movie); });
+}
+
+bool EmulationThread::pushInput(bool pressed, int key)
+{
+    using namespace std::chrono;
+
+    // Frames run as bursts at their deadlines, so the key lands at the same position within the next frame
+    // Parked on FX0A the instruction count stands still, so the key applies at it
+    const auto current = registers.load();
+    auto instruction = current.instructionCount;
+    if (current.isRunning && !current.waitingForKey)
+    {
+        const auto elapsed = duration_cast<microseconds>(steady_clock::now() - current.time).count();
+        instruction += std::max<int64_t>(elapsed, 0) * current.instructionsPerSecond / 1000000;
+    }
+
+    return inputQueue.push(InputEvent{instruction, static_cast<uint8_t>(key), pressed});
+}
+
+const MachineState &EmulationThread::getFrame() const
+{
+    return frames.getReadBuffer();
+}
+
+bool EmulationThread::getView(Chip8State &view)
+{
+    const auto newFrame = frames.update();
+    if (newFrame)
+    {
+        static_cast<MachineState &>(view) = frames.getReadBuffer();
+    }
+
+    // Registers change between frames as well, so they are always the newest ones
+    const auto current = registers.load();
+    view.I = current.I;
+    view.delayTimer = current.delayTimer;
+    view.soundTimer = current.soundTimer;
+    view.stackPointer = current.stackPointer;
+    view.V = current.V;
+    view.instructionPointer = current.instructionPointer;
+    view.stack = current.stack;
+    view.keypad = current.keypad;
+    view.instructionsPerSecond = current.instructionsPerSecond;
+    view.instructionCount = current.instructionCount;
+    view.isRunning = current.isRunning;
+    view.waitingForKey = current.waitingForKey;
+
+    if (debugVersion.load(std::memory_order_acquire) != viewDebugVersion)
+    {
+        std::lock_guard<std::mutex> lock(debugMutex);
+        viewDebugVersion = debugVersion.load(std::memory_order_relaxed);
+        view.game = game ? std::make_unique<Game>(*game) : nullptr;
+        view.breakpoints = breakpoints;
+        view.controlFlow = controlFlow;
+    }
+
+    return newFrame;
+}
+
+EmulationStats EmulationThread::getStats() const
+{
+    return stats.load();
+}
+
+void EmulationThread::run()
+{
+    const auto &state = chip8.getState();
+    reportTime = std::chrono::steady_clock::now();
+    scheduler.reset();
+
+    while (!quit.load(std::memory_order_relaxed))
+    {
+        runCommands();
+
+        if (state.isRunning && warpMode)
+        {
+            instructions += chip8.executeMs(kWarpSliceMs);
+        }
+        else if (state.isRunning)
+        {
+            instructions += chip8.runFrame();
+        }
+        else
+        {
+            chip8.applyInput();
+        }
+
+        publishRegisters();
+        publishFrame();
+        publishStats();
+
+        // Warp mode runs the frames back to back, everything else waits for the next frame
+        if (!warpMode || !state.isRunning || state.waitingForKey)
+        {
+            scheduler.waitForNextFrame();
+        }
+    }
+}
+
+void EmulationThread::runCommands()
+{
+    {
+        std::lock_guard<std::mutex> lock(commandMutex);
+        std::swap(commands, pendingCommands);
+    }
+
+    auto changesDebugInfo = false;
+    for (auto &command : pendingCommands)
+    {
+        command.first(chip8);
+        changesDebugInfo |= command.second;
+    }
+
+    // While stopped there are no frames, but stepping or loading states still changes the display
+    if (!pendingCommands.empty() && !chip8.getState().isRunning)
+    {
+        publishFrame();
+    }
+    pendingCommands.clear();
+
+    // Loaded states only bring new control flow if they change the game, the command can't know
+    changesDebugInfo |= chip8.getState().controlFlow != controlFlow;
+    if (changesDebugInfo)
+    {
+        publishDebugInfo();
+    }
+}
+
+void EmulationThread::publishFrame()
+{
+    frames.getWriteBuffer() = chip8.getState();
+    frames.publish();
+}
+
+void EmulationThread::publishRegisters()
+{
+    const auto &state = chip8.getState();
+    registers.store(Registers{state.I, state.delayTimer, state.soundTimer, state.stackPointer, state.V,
+                              state.instructionPointer, state.stack, state.keypad, state.instructionsPerSecond,
+                              state.instructionCount, state.isRunning, state.waitingForKey,
+                              std::chrono::steady_clock::now()});
+}
+
+void EmulationThread::publishDebugInfo()
+{
+    const auto &state = chip8.getState();
+
+    std::lock_guard<std::mutex> lock(debugMutex);
+    game = state.game ? std::make_unique<Game>(*state.game) : nullptr;
+    breakpoints = state.breakpoints;
+    controlFlow = state.controlFlow;
+    debugVersion.fetch_add(1, std::memory_order_release);
+}
+
+void EmulationThread::publishStats()
+{
+    using namespace std::chrono;
+
+    const auto now = steady_clock::now();
+    const auto elapsed = duration<double>(now - reportTime).count();
+    if (elapsed < 1.0)
+    {
+        return;
+    }
+
+    const auto executed = instructions - reportInstructions;
+    const auto instructionsPerSecond = executed / elapsed;
+    stats.store(EmulationStats{instructions, static_cast<uint64_t>(instructionsPerSecond),
+                               instructionsPerSecond / chip8.getState().instructionsPerSecond});
+
+    reportInstructions = instructions;
+    reportTime = now;
+}
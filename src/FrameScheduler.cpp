@@ -0,0 +1,60 @@
+//--------------------------------------------------------------------------------------------------
+// Cross-Platform Chip-8 Emulator
+// Copyright (C) 2020 Enrico Schörnick
+// Licensed under the MIT License
+//--------------------------------------------------------------------------------------------------
+
+#include "chip8/FrameScheduler.hpp"
+
+#include <thread>
+
+#if defined(__linux__)
+#define CHIP8_CLOCK_NANOSLEEP
+#include <time.h>
+#include <cerrno>
+#endif
+
+void FrameScheduler::reset()
+{
+    start = std::chrono::steady_clock::now();
+    frame = 0;
+}
+
+void FrameScheduler::waitForNextFrame()
+{
+    frame++;
+
+    const auto now = std::chrono::steady_clock::now();
+    if (now > getDeadline(frame + kMaxLag))
+    {
+        reset();
+        return;
+    }
+
+    sleepUntil(getDeadline(frame));
+}
+
+std::chrono::steady_clock::time_point FrameScheduler::getDeadline(uint64_t frame) const
+{
+    using namespace std::chrono;
+
+    // Whole seconds and the frames within the current one, so there is neither rounding drift nor overflow
+    const auto seconds = frame / kFramesPerSecond;
+    const auto nanoseconds = (frame % kFramesPerSecond) * 1000000000 / kFramesPerSecond;
+    return start + duration_cast<steady_clock::duration>(std::chrono::seconds(seconds) +
+                                                         std::chrono::nanoseconds(nanoseconds));
+}
+
+void FrameScheduler::sleepUntil(std::chrono::steady_clock::time_point deadline)
+{
+#ifdef CHIP8_CLOCK_NANOSLEEP
+    // steady_clock is CLOCK_MONOTONIC, the absolute deadline doesn't move if the sleep gets interrupted
+    const auto time = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline.time_since_epoch()).count();
+    const timespec request{static_cast<time_t>(time / 1000000000), static_cast<long>(time % 1000000000)};
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &request, nullptr) == EINTR)
+    {
+    }
+#else
+    std::this_thread::sleep_until(deadline);
+#endif
+}
@@ -0,0 +1,174 @@
+//--------------------------------------------------------------------------------------------------
+// Cross-Platform Chip-8 Emulator
+// Copyright (C) 2020 Enrico Schörnick
+// Licensed under the MIT License
+//--------------------------------------------------------------------------------------------------
+
+#include "chip8/InputMovie.hpp"
+#include "chip8/SaveState.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+
+void InputMovie::startRecording(const MachineState &state, const std::string &game)
+{
+    startState = std::make_unique<MachineState>(state);
+    this->game = game;
+    events.clear();
+    frames = 0;
+}
+
+void InputMovie::recordButton(const MachineState &state, bool pressed, int key)
+{
+    if (startState)
+    {
+        events.push_back({state.instructionCount, frames, pressed ? MovieEvent::Press : MovieEvent::Release,
+                          static_cast<uint8_t>(key)});
+    }
+}
+
+void InputMovie::recordFrame(const MachineState &state)
+{
+    if (startState)
+    {
+        events.push_back({state.instructionCount, frames++, MovieEvent::Frame, 0});
+    }
+}
+
+bool InputMovie::save(const std::string &path) const
+{
+    if (!startState)
+    {
+        std::cout << "Error: Nothing recorded" << std::endl;
+        return false;
+    }
+
+    MovieHeader header{};
+    memcpy(header.magic, MovieHeader::kMagic, sizeof(header.magic));
+    header.version = MovieHeader::kVersion;
+    header.stateVersion = SaveStateHeader::kVersion;
+    header.eventCount = events.size();
+    header.byteOrder = MovieHeader::kByteOrder;
+    memcpy(header.game, game.data(), std::min(game.size(), sizeof(header.game) - 1));
+
+    std::fstream movieFile(path, std::ios::out | std::ios::binary);
+    if (!movieFile.is_open())
+    {
+        std::cout << "Error: Couldn't open " << path << std::endl;
+        return false;
+    }
+
+    movieFile.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    movieFile.write(reinterpret_cast<const char *>(startState.get()), sizeof(MachineState));
+    movieFile.write(reinterpret_cast<const char *>(events.data()), events.size() * sizeof(MovieEvent));
+    return movieFile.good();
+}
+
+bool InputMovie::load(const std::string &path)
+{
+    std::ifstream movieFile(path, std::ios::in | std::ios::binary);
+    if (!movieFile)
+    {
+        std::cout << "Error: Couldn't open " << path << std::endl;
+        return false;
+    }
+
+    MovieHeader header{};
+    movieFile.read(reinterpret_cast<char *>(&header), sizeof(header));
+    if (!movieFile || memcmp(header.magic, MovieHeader::kMagic, sizeof(header.magic)) != 0 ||
+        header.version != MovieHeader::kVersion || header.stateVersion != SaveStateHeader::kVersion ||
+        header.byteOrder != MovieHeader::kByteOrder)
+    {
+        std::cout << "Error: " << path << " is no input movie of this emulator version" << std::endl;
+        return false;
+    }
+
+    // The event count comes from the file, so it can't be trusted before the events are there
+    const auto dataStart = movieFile.tellg();
+    movieFile.seekg(0, std::ios::end);
+    const uint64_t dataSize = movieFile.tellg() - dataStart;
+    movieFile.seekg(dataStart);
+    if (dataSize < sizeof(MachineState) || header.eventCount > (dataSize - sizeof(MachineState)) / sizeof(MovieEvent))
+    {
+        std::cout << "Error: " << path << " is truncated" << std::endl;
+        return false;
+    }
+
+    auto state = std::make_unique<MachineState>();
+    std::vector<MovieEvent> loadedEvents(header.eventCount);
+    movieFile.read(reinterpret_cast<char *>(state.get()), sizeof(MachineState));
+    movieFile.read(reinterpret_cast<char *>(loadedEvents.data()), loadedEvents.size() * sizeof(MovieEvent));
+    if (!movieFile)
+    {
+        std::cout << "Error: " << path << " is truncated" << std::endl;
+        return false;
+    }
+
+    if (!state->isValid())
+    {
+        std::cout << "Error: " << path << " contains registers out of range" << std::endl;
+        return false;
+    }
+
+    startState = std::move(state);
+    game.assign(header.game, strnlen(header.game, sizeof(header.game)));
+    events = std::move(loadedEvents);
+    frames = std::count_if(events.begin(), events.end(), [](const auto &event) { return event.type == MovieEvent::Frame; });
+    return true;
+}
+
+bool InputMovie::replay(Chip8 &chip8) const
+{
+    if (!startState)
+    {
+        std::cout << "Error: No input movie loaded" << std::endl;
+        return false;
+    }
+
+    const auto &state = chip8.getState();
+    chip8.loadState(*startState);
+    chip8.start();
+
+    for (const auto &event : events)
+    {
+        if (event.instruction > state.instructionCount)
+        {
+            chip8.execute(event.instruction - state.instructionCount);
+        }
+
+        // Only a stop (breakpoint) or a different start can get the machine out of sync
+        if (state.instructionCount != event.instruction)
+        {
+            std::cout << "Error: Replay diverged from the movie in frame " << event.frame << std::endl;
+            return false;
+        }
+
+        if (event.type == MovieEvent::Frame)
+        {
+            chip8.updateTimers();
+        }
+        else
+        {
+            chip8.setButton(event.type == MovieEvent::Press, event.key & 0xF);
+        }
+    }
+
+    return true;
+}
+
+const MachineState &InputMovie::getStartState() const
+{
+    return *startState;
+}
+
+const std::vector<MovieEvent> &InputMovie::getEvents() const
+{
+    return events;
+}
+
+std::string InputMovie::getGame() const
+{
+    return game;
+}
@@ -0,0 +1,579 @@
+//--------------------------------------------------------------------------------------------------
+// Cross-Platform Chip-8 Emulator
+// Copyright (C) 2020 Enrico Schörnick
+// Licensed under the MIT License
+//--------------------------------------------------------------------------------------------------
+
+#include "chip8/Chip8.hpp"
+#include "chip8/JitCompiler.hpp"
+
+#include <cstring>
+#include <algorithm>
+
+#if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__))
+#define CHIP8_JIT_SUPPORTED 1
+#include <sys/mman.h>
+#endif
+
+namespace
+{
+    /**
+     * Minimal x86-64 machine code emitter. Compiled blocks keep the Chip8State
+     * pointer in rbx and the helper context in r12, all Chip-8 registers are
+     * accessed directly in memory relative to rbx.
+     */
+    class Emitter
+    {
+    public:
+        std::vector<uint8_t> bytes;
+
+        void emit(std::initializer_list<uint8_t> values)
+        {
+            bytes.insert(bytes.end(), values);
+        }
+
+        void emit8(uint8_t value)
+        {
+            bytes.push_back(value);
+        }
+
+        void emit16(uint16_t value)
+        {
+            emit({static_cast<uint8_t>(value), static_cast<uint8_t>(value >> 8)});
+        }
+
+        void emit32(uint32_t value)
+        {
+            for (int i = 0; i < 4; i++)
+            {
+                emit8(static_cast<uint8_t>(value >> (i * 8)));
+            }
+        }
+
+        void emit64(uint64_t value)
+        {
+            for (int i = 0; i < 8; i++)
+            {
+                emit8(static_cast<uint8_t>(value >> (i * 8)));
+            }
+        }
+
+        // push rbx; push r12; push r13; mov rbx, rdi; mov r12, rsi
+        void prologue()
+        {
+            emit({0x53, 0x41, 0x54, 0x41, 0x55, 0x48, 0x89, 0xFB, 0x49, 0x89, 0xF4});
+        }
+
+        // pop r13; pop r12; pop rbx; ret
+        void epilogue()
+        {
+            emit({0x41, 0x5D, 0x41, 0x5C, 0x5B, 0xC3});
+        }
+
+        // movzx eax, byte [rbx + disp]
+        void loadByteEax(int32_t disp)
+        {
+            emit({0x0F, 0xB6, 0x83});
+            emit32(disp);
+        }
+
+        // movzx ecx, byte [rbx + disp]
+        void loadByteEcx(int32_t disp)
+        {
+            emit({0x0F, 0xB6, 0x8B});
+            emit32(disp);
+        }
+
+        // mov byte [rbx + disp], al
+        void storeByteAl(int32_t disp)
+        {
+            emit({0x88, 0x83});
+            emit32(disp);
+        }
+
+        // mov byte [rbx + disp], dl
+        void storeByteDl(int32_t disp)
+        {
+            emit({0x88, 0x93});
+            emit32(disp);
+        }
+
+        // mov byte [rbx + disp], imm8
+        void storeByteImm(int32_t disp, uint8_t value)
+        {
+            emit({0xC6, 0x83});
+            emit32(disp);
+            emit8(value);
+        }
+
+        // add byte [rbx + disp], imm8
+        void addByteImm(int32_t disp, uint8_t value)
+        {
+            emit({0x80, 0x83});
+            emit32(disp);
+            emit8(value);
+        }
+
+        // cmp byte [rbx + disp], imm8
+        void compareByteImm(int32_t disp, uint8_t value)
+        {
+            emit({0x80, 0xBB});
+            emit32(disp);
+            emit8(value);
+        }
+
+        // movzx eax, word [rbx + disp]
+        void loadWordEax(int32_t disp)
+        {
+            emit({0x0F, 0xB7, 0x83});
+            emit32(disp);
+        }
+
+        // mov word [rbx + disp], ax
+        void storeWordAx(int32_t disp)
+        {
+            emit({0x66, 0x89, 0x83});
+            emit32(disp);
+        }
+
+        // mov word [rbx + disp], imm16
+        void storeWordImm(int32_t disp, uint16_t value)
+        {
+            emit({0x66, 0xC7, 0x83});
+            emit32(disp);
+            emit16(value);
+        }
+
+        // mov eax, imm32
+        void moveEax(uint32_t value)
+        {
+            emit8(0xB8);
+            emit32(value);
+        }
+
+        // mov ecx, imm32
+        void moveEcx(uint32_t value)
+        {
+            emit8(0xB9);
+            emit32(value);
+        }
+
+        // mov eax, first; mov ecx, second; cmovcc eax, ecx (condition code cc)
+        void select(uint32_t first, uint32_t second, uint8_t cc)
+        {
+            moveEax(first);
+            moveEcx(second);
+            emit({0x0F, static_cast<uint8_t>(0x40 | cc), 0xC1});
+        }
+
+        // setcc dl
+        void setDl(uint8_t cc)
+        {
+            emit({0x0F, static_cast<uint8_t>(0x90 | cc), 0xC2});
+        }
+
+        // mov rdi, r12; mov rsi, imm64; mov rax, imm64; call rax
+        void callHelper(uint64_t function, uint64_t argument)
+        {
+            emit({0x4C, 0x89, 0xE7, 0x48, 0xBE});
+            emit64(argument);
+            emit({0x48, 0xB8});
+            emit64(function);
+            emit({0xFF, 0xD0});
+        }
+    };
+
+    // x86 condition codes
+    const uint8_t kCondCarry{0x2};
+    const uint8_t kCondNoCarry{0x3};
+    const uint8_t kCondEqual{0x4};
+    const uint8_t kCondNotEqual{0x5};
+    const uint8_t kCondAbove{0x7};
+
+    bool isBlockTerminator(Opcode type)
+    {
+        switch (type) {
+        case Opcode::CPU_00EE:
+        case Opcode::CPU_1NNN:
+        case Opcode::CPU_2NNN:
+        case Opcode::CPU_3XNN:
+        case Opcode::CPU_4XNN:
+        case Opcode::CPU_5XY0:
+        case Opcode::CPU_9XY0:
+        case Opcode::CPU_BNNN:
+        case Opcode::CPU_EX9E:
+        case Opcode::CPU_EXA1:
+            return true;
+        default:
+            return false;
+        }
+    }
+}
+
+JitCompiler::JitCompiler(Helper helper, void *context) : helper{helper}, context{context}
+{
+#ifdef CHIP8_JIT_SUPPORTED
+    auto memory = mmap(nullptr, kCodeSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    code = (memory == MAP_FAILED) ? nullptr : static_cast<uint8_t *>(memory);
+#endif
+}
+
+JitCompiler::~JitCompiler()
+{
+#ifdef CHIP8_JIT_SUPPORTED
+    if (code != nullptr)
+    {
+        munmap(code, kCodeSize);
+    }
+#endif
+}
+
+bool JitCompiler::isSupported()
+{
+#ifdef CHIP8_JIT_SUPPORTED
+    return true;
+#else
+    return false;
+#endif
+}
+
+JitCompiler::Block JitCompiler::getBlock(uint16_t address) const
+{
+    return blocks[address & 0xFFF];
+}
+
+uint8_t JitCompiler::getBlockLength(uint16_t address) const
+{
+    return blockLength[address & 0xFFF];
+}
+
+bool JitCompiler::recordExecution(uint16_t address)
+{
+    // Returns true exactly once, when the address becomes hot
+    auto &counter = heat[address & 0xFFF];
+    if (counter < kHotThreshold)
+    {
+        counter++;
+        return counter == kHotThreshold && !uncompilable[address & 0xFFF];
+    }
+    return false;
+}
+
+JitCompiler::Block JitCompiler::compile(const Chip8State &state, uint16_t address)
+{
+    if (code == nullptr)
+    {
+        return nullptr;
+    }
+
+    // Offset of a state member relative to the state pointer in rbx
+    auto offset = [&](const void *member) {
+        return static_cast<int32_t>(reinterpret_cast<const uint8_t *>(member) -
+                                    reinterpret_cast<const uint8_t *>(&state));
+    };
+    auto reg = [&](uint8_t index) { return offset(&state.V[index]); };
+    const auto offsetI = offset(&state.I);
+    const auto offsetDT = offset(&state.delayTimer);
+    const auto offsetST = offset(&state.soundTimer);
+    const auto offsetSP = offset(&state.stackPointer);
+    const auto offsetStack = offset(state.stack.data());
+    const auto offsetKeypad = offset(state.keypad.data());
+    const auto helperAddress = reinterpret_cast<uint64_t>(helper);
+
+    Emitter e;
+    e.prologue();
+
+    uint16_t pc = address;
+    int length = 0;
+    auto terminated = false;
+
+    while (!terminated && length < kMaxBlockLength)
+    {
+        // Memory at the end of the address space and overwritten code stay interpreted
+        if (pc >= 0xFFF || selfModified[pc] || selfModified[pc + 1])
+        {
+            break;
+        }
+
+        const auto op = predecode(state.memory[pc] << 8 | state.memory[pc + 1]);
+        const uint16_t next = pc + 2;
+
+        // Waiting for a key modifies the instruction pointer, leave it to the interpreter
+        if (op.type == Opcode::CPU_FX0A)
+        {
+            break;
+        }
+
+        switch (op.type) {
+        case Opcode::Invalid:
+            break;
+        case Opcode::CPU_00EE:
+            // dec byte [sp]; movzx eax, byte [sp]; movzx eax, word [rbx + rax * 2 + stack]
+            e.emit({0xFE, 0x8B});
+            e.emit32(offsetSP);
+            e.loadByteEax(offsetSP);
+            e.emit({0x0F, 0xB7, 0x84, 0x43});
+            e.emit32(offsetStack);
+            break;
+        case Opcode::CPU_1NNN:
+            e.moveEax(op.nnn);
+            break;
+        case Opcode::CPU_2NNN:
+            // movzx eax, byte [sp]; mov word [rbx + rax * 2 + stack], next; inc byte [sp]
+            e.loadByteEax(offsetSP);
+            e.emit({0x66, 0xC7, 0x84, 0x43});
+            e.emit32(offsetStack);
+            e.emit16(next);
+            e.emit({0xFE, 0x83});
+            e.emit32(offsetSP);
+            e.moveEax(op.nnn);
+            break;
+        case Opcode::CPU_3XNN:
+            e.compareByteImm(reg(op.x), op.nn);
+            e.select(next, next + 2, kCondEqual);
+            break;
+        case Opcode::CPU_4XNN:
+            e.compareByteImm(reg(op.x), op.nn);
+            e.select(next, next + 2, kCondNotEqual);
+            break;
+        case Opcode::CPU_5XY0:
+        case Opcode::CPU_9XY0:
+            // movzx eax, VX; cmp al, VY
+            e.loadByteEax(reg(op.x));
+            e.emit({0x3A, 0x83});
+            e.emit32(reg(op.y));
+            e.select(next, next + 2, op.type == Opcode::CPU_5XY0 ? kCondEqual : kCondNotEqual);
+            break;
+        case Opcode::CPU_6XNN:
+            e.storeByteImm(reg(op.x), op.nn);
+            break;
+        case Opcode::CPU_7XNN:
+            e.addByteImm(reg(op.x), op.nn);
+            break;
+        case Opcode::CPU_8XY0:
+            e.loadByteEax(reg(op.y));
+            e.storeByteAl(reg(op.x));
+            break;
+        case Opcode::CPU_8XY1:
+        case Opcode::CPU_8XY2:
+        case Opcode::CPU_8XY3:
+            // or/and/xor al, cl
+            e.loadByteEax(reg(op.x));
+            e.loadByteEcx(reg(op.y));
+            e.emit8(op.type == Opcode::CPU_8XY1 ? 0x08 : (op.type == Opcode::CPU_8XY2 ? 0x20 : 0x30));
+            e.emit8(0xC8);
+            e.storeByteAl(reg(op.x));
+            break;
+        case Opcode::CPU_8XY4:
+        case Opcode::CPU_8XY5:
+        case Opcode::CPU_8XY7:
+            // The flag gets written first and the operands are loaded again afterwards,
+            // exactly like the interpreter does it (matters if X or Y is F)
+            if (op.type == Opcode::CPU_8XY7)
+            {
+                e.loadByteEax(reg(op.y));
+                e.loadByteEcx(reg(op.x));
+            }
+            else
+            {
+                e.loadByteEax(reg(op.x));
+                e.loadByteEcx(reg(op.y));
+            }
+            e.emit({static_cast<uint8_t>(op.type == Opcode::CPU_8XY4 ? 0x00 : 0x28), 0xC8});
+            e.setDl(op.type == Opcode::CPU_8XY4 ? kCondCarry : kCondNoCarry);
+            e.storeByteDl(reg(0xF));
+            if (op.type == Opcode::CPU_8XY7)
+            {
+                e.loadByteEax(reg(op.y));
+                e.loadByteEcx(reg(op.x));
+            }
+            else
+            {
+                e.loadByteEax(reg(op.x));
+                e.loadByteEcx(reg(op.y));
+            }
+            e.emit({static_cast<uint8_t>(op.type == Opcode::CPU_8XY4 ? 0x00 : 0x28), 0xC8});
+            e.storeByteAl(reg(op.x));
+            break;
+        case Opcode::CPU_8XY6:
+            // VF = VX & 1; VX = VX >> 1
+            e.loadByteEax(reg(op.x));
+            e.emit({0x24, 0x01});
+            e.storeByteAl(reg(0xF));
+            e.loadByteEax(reg(op.x));
+            e.emit({0xD0, 0xE8});
+            e.storeByteAl(reg(op.x));
+            break;
+        case Opcode::CPU_8XYE:
+            // VF = VX >> 7; VX = VX << 1
+            e.loadByteEax(reg(op.x));
+            e.emit({0xC0, 0xE8, 0x07});
+            e.storeByteAl(reg(0xF));
+            e.loadByteEax(reg(op.x));
+            e.emit({0xD0, 0xE0});
+            e.storeByteAl(reg(op.x));
+            break;
+        case Opcode::CPU_ANNN:
+            e.storeWordImm(offsetI, op.nnn);
+            break;
+        case Opcode::CPU_BNNN:
+            // movzx eax, V0; add eax, nnn
+            e.loadByteEax(reg(0));
+            e.emit8(0x05);
+            e.emit32(op.nnn);
+            break;
+        case Opcode::CPU_EX9E:
+        case Opcode::CPU_EXA1:
+            // movzx eax, VX; cmp byte [rbx + rax + keypad], 0
+            e.loadByteEax(reg(op.x));
+            e.emit({0x80, 0xBC, 0x03});
+            e.emit32(offsetKeypad);
+            e.emit8(0);
+            e.select(next, next + 2, op.type == Opcode::CPU_EX9E ? kCondNotEqual : kCondEqual);
+            break;
+        case Opcode::CPU_FX07:
+            e.loadByteEax(offsetDT);
+            e.storeByteAl(reg(op.x));
+            break;
+        case Opcode::CPU_FX15:
+            e.loadByteEax(reg(op.x));
+            e.storeByteAl(offsetDT);
+            break;
+        case Opcode::CPU_FX18:
+            e.loadByteEax(reg(op.x));
+            e.storeByteAl(offsetST);
+            break;
+        case Opcode::CPU_FX1E:
+            // VF = (I + VX > 0xFFF); I += VX
+            e.loadWordEax(offsetI);
+            e.loadByteEcx(reg(op.x));
+            e.emit({0x01, 0xC8, 0x3D});
+            e.emit32(0xFFF);
+            e.setDl(kCondAbove);
+            e.storeByteDl(reg(0xF));
+            e.loadWordEax(offsetI);
+            e.loadByteEcx(reg(op.x));
+            e.emit({0x01, 0xC8});
+            e.storeWordAx(offsetI);
+            break;
+        case Opcode::CPU_FX29:
+            // lea eax, [rax + rax * 4]
+            e.loadByteEax(reg(op.x));
+            e.emit({0x8D, 0x04, 0x80});
+            e.storeWordAx(offsetI);
+            break;
+        default:
+        {
+            // Everything else is executed by the interpreter handler
+            uint64_t packed = 0;
+            memcpy(&packed, &op, sizeof(op));
+            e.callHelper(helperAddress, packed);
+            break;
+        }
+        }
+
+        length++;
+        pc = next;
+
+        if (isBlockTerminator(op.type))
+        {
+            terminated = true;
+        }
+        else if (op.type == Opcode::CPU_FX33 || op.type == Opcode::CPU_FX55 ||
+                 std::find(state.breakpoints.begin(), state.breakpoints.end(), pc) != state.breakpoints.end())
+        {
+            // Memory writes may invalidate the following code and breakpoints have to stop us
+            break;
+        }
+    }
+
+    if (length == 0)
+    {
+        uncompilable.set(address & 0xFFF);
+        return nullptr;
+    }
+
+    // Blocks without a control flow instruction at the end continue behind their last instruction
+    if (!terminated)
+    {
+        e.moveEax(pc);
+    }
+    e.epilogue();
+
+    auto block = install(e.bytes);
+    if (block != nullptr)
+    {
+        blocks[address & 0xFFF] = block;
+        blockLength[address & 0xFFF] = static_cast<uint8_t>(length);
+        blockInfos.push_back(BlockInfo{address, pc});
+    }
+
+    return block;
+}
+
+JitCompiler::Block JitCompiler::install(const std::vector<uint8_t> &bytes)
+{
+#ifdef CHIP8_JIT_SUPPORTED
+    // Start all over again if the code buffer is full
+    if (codeUsed + bytes.size() > kCodeSize)
+    {
+        flush();
+    }
+
+    // The code buffer is only writable while we copy a new block into it
+    mprotect(code, kCodeSize, PROT_READ | PROT_WRITE);
+    memcpy(code + codeUsed, bytes.data(), bytes.size());
+    mprotect(code, kCodeSize, PROT_READ | PROT_EXEC);
+
+    auto block = reinterpret_cast<Block>(code + codeUsed);
+
+    // Keep every block 16 byte aligned
+    codeUsed += (bytes.size() + 15) & ~static_cast<size_t>(15);
+    return block;
+#else
+    static_cast<void>(bytes);
+    return nullptr;
+#endif
+}
+
+void JitCompiler::invalidate(uint16_t address, uint16_t length)
+{
+    const int first = address;
+    const int last = address + length;
+
+    // Written bytes are never compiled again
+    for (int i = first; i < last; i++)
+    {
+        selfModified.set(i & 0xFFF);
+    }
+
+    // Drop every block which contains one of the written bytes
+    blockInfos.erase(std::remove_if(blockInfos.begin(), blockInfos.end(), [&](const BlockInfo &info) {
+                         if (info.start < last && first < info.end)
+                         {
+                             // The start address has to get hot again before it's recompiled
+                             blocks[info.start & 0xFFF] = nullptr;
+                             heat[info.start & 0xFFF] = 0;
+                             return true;
+                         }
+                         return false;
+                     }),
+                     blockInfos.end());
+}
+
+void JitCompiler::reset()
+{
+    flush();
+    uncompilable.reset();
+    selfModified.reset();
+}
+
+void JitCompiler::flush()
+{
+    // Drop all compiled blocks, they get compiled again once they are hot
+    blocks.fill(nullptr);
+    blockLength.fill(0);
+    heat.fill(0);
+    blockInfos.clear();
+    codeUsed = 0;
+}
@@ -0,0 +1,528 @@
+//--------------------------------------------------------------------------------------------------
+// Cross-Platform Chip-8 Emulator
+// Copyright (C) 2020 Enrico Schörnick
+// Licensed under the MIT License
+//--------------------------------------------------------------------------------------------------
+
+#include "chip8/LockstepEngine.hpp"
+#include "chip8/Chip8.hpp"
+
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/**
+ * The instruction semantics are the same as the handlers in Chip8.cpp. Simple
+ * instructions are written as loops over all lanes which the compiler turns
+ * into vector instructions, every write is blended with the lane mask.
+ * Instructions with lane dependent memory addresses (sprites, stack, memory
+ * transfers) loop over the active lanes one by one.
+ */
+
+namespace
+{
+    constexpr int kLanes{LockstepEngine::kLanes};
+
+    // Sets every active lane of target to the value of the lane
+    template <typename T, typename Mask, typename Value>
+    inline void assign(std::array<T, kLanes> &target, const Mask &mask, Value value)
+    {
+        for (int lane = 0; lane < kLanes; lane++)
+        {
+            target[lane] = mask[lane] ? static_cast<T>(value(lane)) : target[lane];
+        }
+    }
+
+    // Calls function for every active lane
+    template <typename Mask, typename Function>
+    inline void forEachLane(const Mask &mask, Function function)
+    {
+        for (int lane = 0; lane < kLanes; lane++)
+        {
+            if (mask[lane])
+            {
+                function(lane);
+            }
+        }
+    }
+}
+
+LockstepEngine::LockstepEngine()
+{
+    for (int lane = 0; lane < kLanes; lane++)
+    {
+        random[lane] = lane + 1;
+    }
+}
+
+void LockstepEngine::loadState(const MachineState &state)
+{
+    for (int lane = 0; lane < kLanes; lane++)
+    {
+        for (int i = 0; i < 16; i++)
+        {
+            V[i][lane] = state.V[i];
+            stack[i][lane] = state.stack[i];
+            keypad[lane] = (keypad[lane] & ~(1 << i)) | (state.keypad[i] << i);
+        }
+
+        for (size_t address = 0; address < memory.size(); address++)
+        {
+            memory[address][lane] = state.memory[address];
+        }
+
+        for (size_t row = 0; row < display.size(); row++)
+        {
+            display[row][lane] = state.display[row];
+        }
+
+        I[lane] = state.I;
+        instructionPointer[lane] = state.instructionPointer;
+        delayTimer[lane] = state.delayTimer;
+        soundTimer[lane] = state.soundTimer;
+        stackPointer[lane] = state.stackPointer;
+        random[lane] = state.random;
+        waitingForKey[lane] = state.waitingForKey ? 0xFF : 0x00;
+        keyRegister[lane] = state.keyRegister;
+        instructionCount[lane] = state.instructionCount;
+    }
+
+    steps = 0;
+}
+
+void LockstepEngine::storeState(int lane, MachineState &state) const
+{
+    for (int i = 0; i < 16; i++)
+    {
+        state.V[i] = V[i][lane];
+        state.stack[i] = stack[i][lane];
+        state.keypad[i] = (keypad[lane] >> i) & 0x1;
+    }
+
+    for (size_t address = 0; address < memory.size(); address++)
+    {
+        state.memory[address] = memory[address][lane];
+    }
+
+    for (size_t row = 0; row < display.size(); row++)
+    {
+        state.display[row] = display[row][lane];
+    }
+
+    state.I = I[lane];
+    state.instructionPointer = instructionPointer[lane];
+    state.delayTimer = delayTimer[lane];
+    state.soundTimer = soundTimer[lane];
+    state.stackPointer = stackPointer[lane];
+    state.random = random[lane];
+    state.waitingForKey = waitingForKey[lane] != 0;
+    state.keyRegister = keyRegister[lane];
+    state.instructionCount = instructionCount[lane];
+}
+
+void LockstepEngine::setKeys(int lane, uint16_t keys)
+{
+    keypad[lane] = keys;
+
+    // Same as pressing the keys one by one on a parked Chip8, the lowest one ends the wait
+    if (waitingForKey[lane] && keys != 0)
+    {
+        for (int key = 15; key >= 0; key--)
+        {
+            V[keyRegister[lane]][lane] = ((keys >> key) & 0x1) ? key : V[keyRegister[lane]][lane];
+        }
+        waitingForKey[lane] = 0x00;
+        instructionPointer[lane] += 2;
+    }
+}
+
+void LockstepEngine::setSeed(int lane, uint32_t seed)
+{
+    // Xorshift never leaves zero
+    random[lane] = (seed != 0) ? seed : 1;
+}
+
+uint64_t LockstepEngine::getDisplayHash(int lane, uint64_t hash) const
+{
+    for (const auto &row : display)
+    {
+        for (int i = 0; i < 8; i++)
+        {
+            hash = (hash ^ ((row[lane] >> (i * 8)) & 0xFF)) * 0x100000001B3;
+        }
+    }
+    return hash;
+}
+
+uint64_t LockstepEngine::getSteps() const
+{
+    return steps;
+}
+
+void LockstepEngine::updateTimers()
+{
+    // Timers which are not zero yet are their own mask
+    assign(delayTimer, delayTimer, [&](int lane) { return delayTimer[lane] - 1; });
+    assign(soundTimer, soundTimer, [&](int lane) { return soundTimer[lane] - 1; });
+}
+
+uint64_t LockstepEngine::execute(uint64_t count)
+{
+    uint64_t executed = 0;
+
+    // Budgets are counted in 16 bit lanes, so long runs get split into chunks
+    while (count > 0)
+    {
+        const auto chunk = std::min<uint64_t>(count, 0xFFFF);
+        executed += executeChunk(static_cast<uint16_t>(chunk));
+        count -= chunk;
+    }
+
+    return executed;
+}
+
+uint64_t LockstepEngine::executeChunk(uint16_t count)
+{
+    // Parked lanes don't take part, lanes which park give back the rest of their budget
+    alignas(16) Lanes<uint16_t> remaining;
+    Lanes<uint16_t> budget;
+    for (int lane = 0; lane < kLanes; lane++)
+    {
+        budget[lane] = waitingForKey[lane] ? 0 : count;
+        remaining[lane] = budget[lane];
+    }
+    uint64_t executed = 0;
+
+    alignas(16) Mask mask;
+    uint16_t opcode;
+    while (const int active = selectLanes(remaining, mask, opcode))
+    {
+        const auto op = predecode(opcode);
+        executeLanes(op, mask);
+        executed += active;
+        steps++;
+
+        if (op.type == Opcode::CPU_FX0A)
+        {
+            forEachLane(waitingForKey, [&](int lane) {
+                budget[lane] -= remaining[lane];
+                remaining[lane] = 0;
+            });
+        }
+    }
+
+    for (int lane = 0; lane < kLanes; lane++)
+    {
+        instructionCount[lane] += budget[lane];
+    }
+    return executed;
+}
+
+int LockstepEngine::selectLanes(Lanes<uint16_t> &remaining, Mask &mask, uint16_t &opcode)
+{
+    /**
+     * Lanes which are behind get the next step, so diverged lanes meet again
+     * after their branches. Lanes which wrote different values into the code
+     * at that address can't take part. The selected lanes fetch the
+     * instruction: their budget gets decreased and their instruction pointer
+     * increased.
+     */
+#if defined(__SSE2__)
+    auto pcLow = _mm_load_si128(reinterpret_cast<const __m128i *>(instructionPointer.data()));
+    auto pcHigh = _mm_load_si128(reinterpret_cast<const __m128i *>(instructionPointer.data() + 8));
+    auto remainingLow = _mm_load_si128(reinterpret_cast<const __m128i *>(remaining.data()));
+    auto remainingHigh = _mm_load_si128(reinterpret_cast<const __m128i *>(remaining.data() + 8));
+
+    const auto idleLow = _mm_cmpeq_epi16(remainingLow, _mm_setzero_si128());
+    const auto idleHigh = _mm_cmpeq_epi16(remainingHigh, _mm_setzero_si128());
+    if (_mm_movemask_epi8(_mm_and_si128(idleLow, idleHigh)) == 0xFFFF)
+    {
+        return 0;
+    }
+
+    // Unsigned minimum with the signed SSE2 instruction, idle lanes are 0xFFFF
+    const auto bias = _mm_set1_epi16(static_cast<int16_t>(0x8000));
+    auto minimum = _mm_min_epi16(_mm_xor_si128(_mm_or_si128(pcLow, idleLow), bias),
+                                 _mm_xor_si128(_mm_or_si128(pcHigh, idleHigh), bias));
+    minimum = _mm_min_epi16(minimum, _mm_shuffle_epi32(minimum, 0x4E));
+    minimum = _mm_min_epi16(minimum, _mm_shuffle_epi32(minimum, 0xB1));
+    minimum = _mm_min_epi16(minimum, _mm_shufflelo_epi16(minimum, 0xB1));
+    const uint16_t leader = _mm_cvtsi128_si32(minimum) ^ 0x8000;
+
+    const auto leaderLanes = _mm_set1_epi16(static_cast<int16_t>(leader));
+    const auto candidates = _mm_packs_epi16(_mm_andnot_si128(idleLow, _mm_cmpeq_epi16(pcLow, leaderLanes)),
+                                            _mm_andnot_si128(idleHigh, _mm_cmpeq_epi16(pcHigh, leaderLanes)));
+    const int leaderLane = __builtin_ctz(_mm_movemask_epi8(candidates));
+
+    const auto &high = memory[leader & 0xFFF];
+    const auto &low = memory[(leader + 1) & 0xFFF];
+    opcode = high[leaderLane] << 8 | low[leaderLane];
+
+    const auto highLanes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(high.data()));
+    const auto lowLanes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(low.data()));
+    const auto selected = _mm_and_si128(candidates, _mm_and_si128(
+        _mm_cmpeq_epi8(highLanes, _mm_set1_epi8(static_cast<char>(opcode >> 8))),
+        _mm_cmpeq_epi8(lowLanes, _mm_set1_epi8(static_cast<char>(opcode & 0xFF)))));
+    _mm_store_si128(reinterpret_cast<__m128i *>(mask.data()), selected);
+
+    // Selected lanes are -1 in 16 bit, so the budget gets added and the instruction pointer subtracted
+    const auto selectedLow = _mm_unpacklo_epi8(selected, selected);
+    const auto selectedHigh = _mm_unpackhi_epi8(selected, selected);
+    remainingLow = _mm_add_epi16(remainingLow, selectedLow);
+    remainingHigh = _mm_add_epi16(remainingHigh, selectedHigh);
+    pcLow = _mm_sub_epi16(pcLow, _mm_add_epi16(selectedLow, selectedLow));
+    pcHigh = _mm_sub_epi16(pcHigh, _mm_add_epi16(selectedHigh, selectedHigh));
+    _mm_store_si128(reinterpret_cast<__m128i *>(remaining.data()), remainingLow);
+    _mm_store_si128(reinterpret_cast<__m128i *>(remaining.data() + 8), remainingHigh);
+    _mm_store_si128(reinterpret_cast<__m128i *>(instructionPointer.data()), pcLow);
+    _mm_store_si128(reinterpret_cast<__m128i *>(instructionPointer.data() + 8), pcHigh);
+
+    return __builtin_popcount(_mm_movemask_epi8(selected));
+#else
+    uint16_t leader = 0xFFFF;
+    uint16_t pending = 0;
+    for (int lane = 0; lane < kLanes; lane++)
+    {
+        leader = std::min<uint16_t>(leader, (remaining[lane] != 0) ? instructionPointer[lane] : 0xFFFF);
+        pending |= remaining[lane];
+    }
+
+    if (pending == 0)
+    {
+        return 0;
+    }
+
+    int leaderLane = 0;
+    while (remaining[leaderLane] == 0 || instructionPointer[leaderLane] != leader)
+    {
+        leaderLane++;
+    }
+
+    const auto &high = memory[leader & 0xFFF];
+    const auto &low = memory[(leader + 1) & 0xFFF];
+    opcode = high[leaderLane] << 8 | low[leaderLane];
+
+    int active = 0;
+    for (int lane = 0; lane < kLanes; lane++)
+    {
+        const bool selected = remaining[lane] != 0 && instructionPointer[lane] == leader &&
+                              high[lane] == high[leaderLane] && low[lane] == low[leaderLane];
+        mask[lane] = selected ? 0xFF : 0x00;
+        remaining[lane] -= selected ? 1 : 0;
+        instructionPointer[lane] += selected ? 2 : 0;
+        active += selected ? 1 : 0;
+    }
+
+    return active;
+#endif
+}
+
+void LockstepEngine::executeLanes(const MicroOp &op, const Mask &mask)
+{
+    auto &vx = V[op.x];
+    auto &vy = V[op.y];
+    auto &vf = V[0xF];
+    auto &pc = instructionPointer;
+
+    switch (op.type) {
+    case Opcode::Invalid:
+        break;
+    case Opcode::CPU_00E0:
+        for (auto &row : display)
+        {
+            assign(row, mask, [&](int) { return 0; });
+        }
+        break;
+    case Opcode::CPU_00EE:
+        forEachLane(mask, [&](int lane) {
+            stackPointer[lane]--;
+            pc[lane] = stack[stackPointer[lane] & 0xF][lane];
+        });
+        break;
+    case Opcode::CPU_1NNN:
+        assign(pc, mask, [&](int) { return op.nnn; });
+        break;
+    case Opcode::CPU_2NNN:
+        forEachLane(mask, [&](int lane) {
+            stack[stackPointer[lane] & 0xF][lane] = pc[lane];
+            stackPointer[lane]++;
+            pc[lane] = op.nnn;
+        });
+        break;
+    case Opcode::CPU_3XNN:
+        assign(pc, mask, [&](int lane) { return pc[lane] + ((vx[lane] == op.nn) ? 2 : 0); });
+        break;
+    case Opcode::CPU_4XNN:
+        assign(pc, mask, [&](int lane) { return pc[lane] + ((vx[lane] != op.nn) ? 2 : 0); });
+        break;
+    case Opcode::CPU_5XY0:
+        assign(pc, mask, [&](int lane) { return pc[lane] + ((vx[lane] == vy[lane]) ? 2 : 0); });
+        break;
+    case Opcode::CPU_6XNN:
+        assign(vx, mask, [&](int) { return op.nn; });
+        break;
+    case Opcode::CPU_7XNN:
+        assign(vx, mask, [&](int lane) { return vx[lane] + op.nn; });
+        break;
+    case Opcode::CPU_8XY0:
+        assign(vx, mask, [&](int lane) { return vy[lane]; });
+        break;
+    case Opcode::CPU_8XY1:
+        assign(vx, mask, [&](int lane) { return vx[lane] | vy[lane]; });
+        break;
+    case Opcode::CPU_8XY2:
+        assign(vx, mask, [&](int lane) { return vx[lane] & vy[lane]; });
+        break;
+    case Opcode::CPU_8XY3:
+        assign(vx, mask, [&](int lane) { return vx[lane] ^ vy[lane]; });
+        break;
+    case Opcode::CPU_8XY4:
+    {
+        // VF gets written first, like in the handlers, so X or Y = F see the flag
+        Lanes<uint8_t> flag;
+        for (int lane = 0; lane < kLanes; lane++)
+        {
+            flag[lane] = (vy[lane] > (0xFF - vx[lane])) ? 1 : 0;
+        }
+        assign(vf, mask, [&](int lane) { return flag[lane]; });
+        assign(vx, mask, [&](int lane) { return vx[lane] + vy[lane]; });
+        break;
+    }
+    case Opcode::CPU_8XY5:
+    {
+        Lanes<uint8_t> flag;
+        for (int lane = 0; lane < kLanes; lane++)
+        {
+            flag[lane] = (vy[lane] > vx[lane]) ? 0 : 1;
+        }
+        assign(vf, mask, [&](int lane) { return flag[lane]; });
+        assign(vx, mask, [&](int lane) { return vx[lane] - vy[lane]; });
+        break;
+    }
+    case Opcode::CPU_8XY6:
+        assign(vf, mask, [&](int lane) { return vx[lane] & 0x1; });
+        assign(vx, mask, [&](int lane) { return vx[lane] >> 1; });
+        break;
+    case Opcode::CPU_8XY7:
+    {
+        Lanes<uint8_t> flag;
+        for (int lane = 0; lane < kLanes; lane++)
+        {
+            flag[lane] = (vx[lane] > vy[lane]) ? 0 : 1;
+        }
+        assign(vf, mask, [&](int lane) { return flag[lane]; });
+        assign(vx, mask, [&](int lane) { return vy[lane] - vx[lane]; });
+        break;
+    }
+    case Opcode::CPU_8XYE:
+        assign(vf, mask, [&](int lane) { return vx[lane] >> 7; });
+        assign(vx, mask, [&](int lane) { return vx[lane] << 1; });
+        break;
+    case Opcode::CPU_9XY0:
+        assign(pc, mask, [&](int lane) { return pc[lane] + ((vx[lane] != vy[lane]) ? 2 : 0); });
+        break;
+    case Opcode::CPU_ANNN:
+        assign(I, mask, [&](int) { return op.nnn; });
+        break;
+    case Opcode::CPU_BNNN:
+        assign(pc, mask, [&](int lane) { return op.nnn + V[0][lane]; });
+        break;
+    case Opcode::CPU_CXNN:
+        // Every lane has its own xorshift generator, so lanes with different seeds diverge
+        for (int lane = 0; lane < kLanes; lane++)
+        {
+            auto value = random[lane];
+            value ^= value << 13;
+            value ^= value >> 17;
+            value ^= value << 5;
+            random[lane] = mask[lane] ? value : random[lane];
+        }
+        assign(vx, mask, [&](int lane) { return op.nn & (random[lane] % 0xFF); });
+        break;
+    case Opcode::CPU_DXYN:
+        forEachLane(mask, [&](int lane) { drawSprite(lane, op); });
+        break;
+    case Opcode::CPU_EX9E:
+        assign(pc, mask, [&](int lane) { return pc[lane] + (((keypad[lane] >> (vx[lane] & 0xF)) & 0x1) ? 2 : 0); });
+        break;
+    case Opcode::CPU_EXA1:
+        assign(pc, mask, [&](int lane) { return pc[lane] + (((keypad[lane] >> (vx[lane] & 0xF)) & 0x1) ? 0 : 2); });
+        break;
+    case Opcode::CPU_FX07:
+        assign(vx, mask, [&](int lane) { return delayTimer[lane]; });
+        break;
+    case Opcode::CPU_FX0A:
+        // Lanes without a pressed key park on this instruction, the highest pressed key wins
+        forEachLane(mask, [&](int lane) {
+            if (keypad[lane] == 0)
+            {
+                pc[lane] -= 2;
+                waitingForKey[lane] = 0xFF;
+                keyRegister[lane] = op.x;
+                return;
+            }
+            for (int key = 0; key < 16; key++)
+            {
+                vx[lane] = ((keypad[lane] >> key) & 0x1) ? key : vx[lane];
+            }
+        });
+        break;
+    case Opcode::CPU_FX15:
+        assign(delayTimer, mask, [&](int lane) { return vx[lane]; });
+        break;
+    case Opcode::CPU_FX18:
+        assign(soundTimer, mask, [&](int lane) { return vx[lane]; });
+        break;
+    case Opcode::CPU_FX1E:
+        assign(vf, mask, [&](int lane) { return (I[lane] + vx[lane] > 0xFFF) ? 1 : 0; });
+        assign(I, mask, [&](int lane) { return I[lane] + vx[lane]; });
+        break;
+    case Opcode::CPU_FX29:
+        assign(I, mask, [&](int lane) { return vx[lane] * 0x5; });
+        break;
+    case Opcode::CPU_FX33:
+        forEachLane(mask, [&](int lane) {
+            memory[I[lane] & 0xFFF][lane] = vx[lane] / 100;
+            memory[(I[lane] + 1) & 0xFFF][lane] = (vx[lane] / 10) % 10;
+            memory[(I[lane] + 2) & 0xFFF][lane] = (vx[lane] % 100) % 10;
+        });
+        break;
+    case Opcode::CPU_FX55:
+        forEachLane(mask, [&](int lane) {
+            for (int i = 0; i <= op.x; i++)
+            {
+                memory[(I[lane] + i) & 0xFFF][lane] = V[i][lane];
+            }
+        });
+        break;
+    case Opcode::CPU_FX65:
+        forEachLane(mask, [&](int lane) {
+            for (int i = 0; i <= op.x; i++)
+            {
+                V[i][lane] = memory[(I[lane] + i) & 0xFFF][lane];
+            }
+        });
+        break;
+    }
+}
+
+void LockstepEngine::drawSprite(int lane, const MicroOp &op)
+{
+    // Same clipping as CPU_DXYN
+    const int xDest = V[op.x][lane] % 64;
+    const int yDest = V[op.y][lane] % 32;
+    const int spriteHeight = std::min<int>(op.n, 32 - yDest);
+
+    uint64_t collision = 0;
+    for (int y = 0; y < spriteHeight; y++)
+    {
+        const uint64_t spriteRowBits = memory[(I[lane] + y) & 0xFFF][lane];
+        const uint64_t spriteRow = (spriteRowBits << 56) >> xDest;
+        collision |= display[yDest + y][lane] & spriteRow;
+        display[yDest + y][lane] ^= spriteRow;
+    }
+
+    V[0xF][lane] = (collision != 0) ? 1 : 0;
+}
@@ -0,0 +1,206 @@
+//--------------------------------------------------------------------------------------------------
+// Cross-Platform Chip-8 Emulator
+// Copyright (C) 2020 Enrico Schörnick
+// Licensed under the MIT License
+//--------------------------------------------------------------------------------------------------
+
+#include "chip8/Profiler.hpp"
+#include "chip8/Disassembler.hpp"
+
+#include <vector>
+#include <fstream>
+#include <iomanip>
+#include <string_view>
+#include <iostream>
+#include <algorithm>
+#include <filesystem>
+
+namespace
+{
+    double getAverage(uint64_t cycles, uint64_t count)
+    {
+        return (count > 0) ? static_cast<double>(cycles) / count : 0.0;
+    }
+
+    template <typename Writer>
+    bool writeFile(const std::string &path, const char *name, Writer writer)
+    {
+        std::ofstream file(path);
+        if (!file.is_open())
+        {
+            std::cout << "Error: Couldn't open " << path << std::endl;
+            return false;
+        }
+
+        writer(file);
+        if (!file)
+        {
+            std::cout << "Error: Couldn't write " << name << " " << path << std::endl;
+            return false;
+        }
+
+        std::cout << "Info: " << name << " saved to " << path << std::endl;
+        return true;
+    }
+
+    std::string_view getInstruction(const Chip8State &state, uint16_t address, char *buffer)
+    {
+        const uint16_t opcode = state.memory[address] << 8 | state.memory[(address + 1) & 0xFFF];
+        return std::string_view(buffer, Disassembler::format(buffer, address, opcode));
+    }
+}
+
+void Profiler::clear()
+{
+    entries.fill(Entry{});
+    addressCounts.fill(0);
+    addressCycles.fill(0);
+}
+
+uint64_t Profiler::getCount(Opcode type) const
+{
+    return entries[static_cast<size_t>(type)].count;
+}
+
+uint64_t Profiler::getCycles(Opcode type) const
+{
+    return entries[static_cast<size_t>(type)].cycles;
+}
+
+uint32_t Profiler::getAddressCount(uint16_t address) const
+{
+    return addressCounts[address & 0xFFF];
+}
+
+uint64_t Profiler::getAddressCycles(uint16_t address) const
+{
+    return addressCycles[address & 0xFFF];
+}
+
+bool Profiler::save(const std::string &path) const
+{
+    const auto csv = std::filesystem::path(path).extension() == ".csv";
+    return writeFile(path, "Profile", [&](std::ostream &stream) {
+        if (csv)
+        {
+            writeCsv(stream);
+        }
+        else
+        {
+            writeJson(stream);
+        }
+    });
+}
+
+bool Profiler::saveHotSpots(const std::string &path, const Chip8State &state) const
+{
+    return writeFile(path, "Hot spots", [&](std::ostream &stream) { writeHotSpots(stream, state); });
+}
+
+bool Profiler::saveCoverage(const std::string &path, const Chip8State &state) const
+{
+    if (!state.game)
+    {
+        std::cout << "Error: Coverage needs a loaded game" << std::endl;
+        return false;
+    }
+    return writeFile(path, "Coverage", [&](std::ostream &stream) { writeCoverage(stream, state); });
+}
+
+void Profiler::writeJson(std::ostream &stream) const
+{
+    uint64_t instructions = 0;
+    uint64_t cycles = 0;
+    for (const auto &entry : entries)
+    {
+        instructions += entry.count;
+        cycles += entry.cycles;
+    }
+
+    stream << std::fixed << std::setprecision(2)
+           << "{\n  \"instructions\": " << instructions << ",\n  \"cycles\": " << cycles << ",\n  \"opcodes\": [\n";
+
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        const auto &entry = entries[i];
+        stream << "    {\"opcode\": \"" << kOpcodeNames[i] << "\", \"count\": " << entry.count
+               << ", \"cycles\": " << entry.cycles
+               << ", \"cyclesPerInstruction\": " << getAverage(entry.cycles, entry.count) << "}"
+               << ((i + 1 < entries.size()) ? ",\n" : "\n");
+    }
+
+    stream << "  ]\n}\n";
+}
+
+void Profiler::writeCsv(std::ostream &stream) const
+{
+    stream << std::fixed << std::setprecision(2) << "opcode,count,cycles,cycles_per_instruction\n";
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        const auto &entry = entries[i];
+        stream << kOpcodeNames[i] << "," << entry.count << "," << entry.cycles << ","
+               << getAverage(entry.cycles, entry.count) << "\n";
+    }
+}
+
+void Profiler::writeHotSpots(std::ostream &stream, const Chip8State &state) const
+{
+    std::vector<uint16_t> addresses;
+    uint64_t instructions = 0;
+    uint64_t cycles = 0;
+    for (uint16_t address = 0; address < addressCounts.size(); address++)
+    {
+        if (addressCounts[address] > 0)
+        {
+            addresses.push_back(address);
+            instructions += addressCounts[address];
+            cycles += addressCycles[address];
+        }
+    }
+
+    std::stable_sort(addresses.begin(), addresses.end(),
+                     [&](uint16_t a, uint16_t b) { return addressCycles[a] > addressCycles[b]; });
+
+    stream << "Hot spots of " << (state.game ? state.game->name : "memory") << ": " << instructions
+           << " instructions, " << cycles << " cycles\n\n"
+           << std::setw(10) << "Count" << std::setw(14) << "Cycles" << std::setw(8) << "Share"
+           << "  Instruction\n"
+           << std::fixed << std::setprecision(1);
+
+    char line[Disassembler::kLineSize];
+    for (const auto address : addresses)
+    {
+        const auto share = (cycles > 0) ? 100.0 * addressCycles[address] / cycles : 0.0;
+        stream << std::setw(10) << addressCounts[address] << std::setw(14) << addressCycles[address]
+               << std::setw(7) << share << "%  " << getInstruction(state, address, line) << "\n";
+    }
+}
+
+void Profiler::writeCoverage(std::ostream &stream, const Chip8State &state) const
+{
+    const auto start = state.kStartAddress;
+    const auto end = std::min<size_t>(start + state.game->size, addressCounts.size());
+
+    size_t instructions = 0;
+    size_t executed = 0;
+    for (auto address = start; address < end; address += 2)
+    {
+        instructions++;
+        executed += (addressCounts[address] > 0);
+    }
+
+    stream << "Coverage of " << state.game->name << ": " << executed << " of " << instructions
+           << " instructions executed (" << std::fixed << std::setprecision(1)
+           << ((instructions > 0) ? 100.0 * executed / instructions : 0.0) << "%)\n";
+
+    // Odd addresses only show up if a jump actually ran code there
+    char line[Disassembler::kLineSize];
+    for (auto address = start; address < end; address++)
+    {
+        const auto wasExecuted = addressCounts[address] > 0;
+        if (address % 2 == 0 || wasExecuted)
+        {
+            stream << (wasExecuted ? "+ " : "- ") << getInstruction(state, address, line) << "\n";
+        }
+    }
+}
@@ -0,0 +1,183 @@
+//--------------------------------------------------------------------------------------------------
+// Cross-Platform Chip-8 Emulator
+// Copyright (C) 2020 Enrico Schörnick
+// Licensed under the MIT License
+//--------------------------------------------------------------------------------------------------
+
+#include "chip8/RewindBuffer.hpp"
+
+#include <cstring>
+#include <algorithm>
+
+namespace
+{
+    const uint64_t *getBlock(const MachineState &state, size_t block)
+    {
+        return reinterpret_cast<const uint64_t *>(&state) + block * 8;
+    }
+
+    uint64_t *getBlock(MachineState &state, size_t block)
+    {
+        return reinterpret_cast<uint64_t *>(&state) + block * 8;
+    }
+}
+
+RewindBuffer::RewindBuffer(size_t seconds) : previous{std::make_unique<MachineState>()}
+{
+    // One group more, so the full time is still available right after the oldest group got dropped
+    groups.resize(std::max<size_t>(seconds * kFramesPerSecond / kKeyframeInterval, 1) + 1);
+    for (auto &group : groups)
+    {
+        group.keyframe = std::make_unique<MachineState>();
+    }
+}
+
+void RewindBuffer::push(const MachineState &state)
+{
+    // Start a new group with a keyframe, the oldest group gets overwritten
+    if (groupCount == 0 || groups[newestGroup].count == kKeyframeInterval)
+    {
+        newestGroup = (groupCount == 0) ? 0 : (newestGroup + 1) % groups.size();
+        groupCount = std::min(groupCount + 1, groups.size());
+
+        auto &group = groups[newestGroup];
+        *group.keyframe = state;
+        group.count = 1;
+        *previous = state;
+        return;
+    }
+
+    auto &group = groups[newestGroup];
+    auto &delta = group.frames[group.count++];
+    delta.blocks.reset();
+    delta.masks.clear();
+    delta.words.clear();
+
+    for (size_t block = 0; block < kBlockCount; block++)
+    {
+        const auto current = getBlock(state, block);
+        if (memcmp(current, getBlock(*previous, block), kBlockSize) == 0)
+        {
+            continue;
+        }
+
+        const auto keyframe = getBlock(*group.keyframe, block);
+        uint8_t mask = 0;
+        for (size_t word = 0; word < kWordsPerBlock; word++)
+        {
+            const auto difference = current[word] ^ keyframe[word];
+            if (difference != 0)
+            {
+                mask |= 1 << word;
+                delta.words.push_back(difference);
+            }
+        }
+
+        delta.blocks.set(block);
+        delta.masks.push_back(mask);
+    }
+
+    *previous = state;
+}
+
+bool RewindBuffer::stepBack(MachineState &state)
+{
+    if (groupCount == 0)
+    {
+        return false;
+    }
+
+    // The newest frame is the current state, so it gets dropped and the one before restored
+    if (groups[newestGroup].count > 1)
+    {
+        groups[newestGroup].count--;
+    }
+    else if (groupCount > 1)
+    {
+        groups[newestGroup].count = 0;
+        newestGroup = (newestGroup + groups.size() - 1) % groups.size();
+        groupCount--;
+    }
+    else
+    {
+        return false;
+    }
+
+    const auto &group = groups[newestGroup];
+    restore(group, group.count - 1, state);
+    *previous = state;
+    return true;
+}
+
+void RewindBuffer::clear()
+{
+    for (auto &group : groups)
+    {
+        group.count = 0;
+    }
+    newestGroup = 0;
+    groupCount = 0;
+}
+
+size_t RewindBuffer::getFrames() const
+{
+    size_t frames = 0;
+    for (const auto &group : groups)
+    {
+        frames += group.count;
+    }
+    return frames;
+}
+
+size_t RewindBuffer::getMemoryUsage() const
+{
+    size_t bytes = 0;
+    for (const auto &group : groups)
+    {
+        bytes += sizeof(group) + sizeof(MachineState);
+        for (const auto &delta : group.frames)
+        {
+            bytes += delta.masks.capacity() + delta.words.capacity() * sizeof(uint64_t);
+        }
+    }
+    return bytes;
+}
+
+void RewindBuffer::restore(const Group &group, size_t frame, MachineState &state) const
+{
+    state = *group.keyframe;
+
+    // The newest version of a block is the first one found while walking back
+    std::bitset<kBlockCount> restored;
+    for (size_t index = frame; index > 0 && !restored.all(); index--)
+    {
+        const auto &delta = group.frames[index];
+        size_t mask = 0;
+        size_t word = 0;
+
+        for (size_t block = 0; block < kBlockCount; block++)
+        {
+            if (!delta.blocks[block])
+            {
+                continue;
+            }
+
+            const auto blockMask = delta.masks[mask++];
+            if (restored[block])
+            {
+                word += std::bitset<kWordsPerBlock>(blockMask).count();
+                continue;
+            }
+
+            auto target = getBlock(state, block);
+            for (size_t i = 0; i < kWordsPerBlock; i++)
+            {
+                if (blockMask & (1 << i))
+                {
+                    target[i] ^= delta.words[word++];
+                }
+            }
+            restored.set(block);
+        }
+    }
+}
@@ -0,0 +1,163 @@
+//--------------------------------------------------------------------------------------------------
+// Cross-Platform Chip-8 Emulator
+// Copyright (C) 2020 Enrico Schörnick
+// Licensed under the MIT License
+//--------------------------------------------------------------------------------------------------
+
+#include "chip8/SaveState.hpp"
+
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <algorithm>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define CHIP8_SAVESTATE_MMAP
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+SaveStateFile::~SaveStateFile()
+{
+    close();
+}
+
+bool SaveStateFile::write(const std::string &path, const MachineState &state, const std::string &game)
+{
+    SaveStateHeader header{};
+    memcpy(header.magic, SaveStateHeader::kMagic, sizeof(header.magic));
+    header.version = SaveStateHeader::kVersion;
+    header.stateSize = sizeof(MachineState);
+    header.byteOrder = SaveStateHeader::kByteOrder;
+    memcpy(header.game, game.data(), std::min(game.size(), sizeof(header.game) - 1));
+
+    std::fstream stateFile(path, std::ios::out | std::ios::binary);
+    if (!stateFile.is_open())
+    {
+        std::cout << "Error: Couldn't open " << path << std::endl;
+        return false;
+    }
+
+    stateFile.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    stateFile.write(reinterpret_cast<const char *>(&state), sizeof(state));
+    return stateFile.good();
+}
+
+bool SaveStateFile::open(const std::string &path)
+{
+    close();
+
+#ifdef CHIP8_SAVESTATE_MMAP
+    const int descriptor = ::open(path.c_str(), O_RDONLY);
+    if (descriptor < 0)
+    {
+        std::cout << "Error: Couldn't open " << path << std::endl;
+        return false;
+    }
+
+    struct stat fileStatus;
+    if (fstat(descriptor, &fileStatus) == 0 && fileStatus.st_size > 0)
+    {
+        size = fileStatus.st_size;
+        auto mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+        if (mapping != MAP_FAILED)
+        {
+            data = static_cast<const uint8_t *>(mapping);
+            mapped = true;
+        }
+    }
+    ::close(descriptor);
+#endif
+
+    // Without mmap the file gets read into a buffer
+    if (!mapped)
+    {
+        std::ifstream stateFile(path, std::ios::in | std::ios::binary);
+        if (!stateFile)
+        {
+            std::cout << "Error: Couldn't open " << path << std::endl;
+            return false;
+        }
+
+        buffer.assign(std::istreambuf_iterator<char>(stateFile), std::istreambuf_iterator<char>());
+        data = buffer.data();
+        size = buffer.size();
+    }
+
+    if (!isValid())
+    {
+        std::cout << "Error: " << path << " is no save state of this emulator version" << std::endl;
+        close();
+        return false;
+    }
+
+    // The state in the buffer isn't aligned
+    if (!mapped)
+    {
+        copy = std::make_unique<MachineState>();
+        memcpy(static_cast<void *>(copy.get()), data + sizeof(SaveStateHeader), sizeof(MachineState));
+    }
+
+    if (!getState()->isValid())
+    {
+        std::cout << "Error: " << path << " contains registers out of range" << std::endl;
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void SaveStateFile::close()
+{
+#ifdef CHIP8_SAVESTATE_MMAP
+    if (mapped)
+    {
+        munmap(const_cast<uint8_t *>(data), size);
+    }
+#endif
+
+    data = nullptr;
+    size = 0;
+    mapped = false;
+    buffer.clear();
+    copy.reset();
+}
+
+bool SaveStateFile::isValid() const
+{
+    if (data == nullptr || size != sizeof(SaveStateHeader) + sizeof(MachineState))
+    {
+        return false;
+    }
+
+    SaveStateHeader header;
+    memcpy(&header, data, sizeof(header));
+    return memcmp(header.magic, SaveStateHeader::kMagic, sizeof(header.magic)) == 0 &&
+           header.version == SaveStateHeader::kVersion && header.stateSize == sizeof(MachineState) &&
+           header.byteOrder == SaveStateHeader::kByteOrder;
+}
+
+const MachineState *SaveStateFile::getState() const
+{
+    if (copy)
+    {
+        return copy.get();
+    }
+    return (data != nullptr) ? reinterpret_cast<const MachineState *>(data + sizeof(SaveStateHeader)) : nullptr;
+}
+
+std::string SaveStateFile::getGame() const
+{
+    if (data == nullptr)
+    {
+        return "";
+    }
+
+    const auto game = reinterpret_cast<const char *>(data) + offsetof(SaveStateHeader, game);
+    return std::string(game, strnlen(game, sizeof(SaveStateHeader::game)));
+}
@@ -0,0 +1,164 @@
+//--------------------------------------------------------------------------------------------------
+// Cross-Platform Chip-8 Emulator
+// Copyright (C) 2020 Enrico Schörnick
+// Licensed under the MIT License
+//--------------------------------------------------------------------------------------------------
+
+#include "chip8/Chip8.hpp"
+
+#include <algorithm>
+
+/**
+ * Peephole pass which fuses common instruction sequences of the loaded game
+ * into superinstructions. The cached decoder executes a superinstruction with
+ * a single dispatch but still counts every fused instruction. Sequences with
+ * a breakpoint in between never get fused, so stopping works exactly like
+ * with single instructions.
+ */
+
+void Chip8::fuseInstructions()
+{
+    fusions.fill(Fusion{});
+
+    if (!state.game)
+    {
+        return;
+    }
+
+    const int end = state.kStartAddress + state.game->size;
+    for (int i = state.kStartAddress; i < end; i++)
+    {
+        fusions[i] = findFusion(i);
+    }
+}
+
+Fusion Chip8::findFusion(uint16_t address) const
+{
+    // Fused instructions must be decoded and must not be a breakpoint
+    auto instruction = [&](int index) -> const MicroOp * {
+        const auto current = address + index * sizeof(opcode);
+        if (current + 1 > 0xFFF || !instructionCache[current].valid)
+        {
+            return nullptr;
+        }
+        if (index > 0 && std::find(state.breakpoints.begin(), state.breakpoints.end(),
+                                   current) != state.breakpoints.end())
+        {
+            return nullptr;
+        }
+        return &instructionCache[current];
+    };
+
+    auto is = [&](const MicroOp *op, Opcode type) { return op != nullptr && op->type == type; };
+
+    const auto first = instruction(0);
+    const auto second = instruction(1);
+    if (first == nullptr || second == nullptr)
+    {
+        return Fusion{};
+    }
+
+    // ANNN, DXYN
+    if (is(first, Opcode::CPU_ANNN) && is(second, Opcode::CPU_DXYN))
+    {
+        return Fusion{Superinstruction::LoadDraw, 2};
+    }
+
+    // FX29, DXY5
+    if (is(first, Opcode::CPU_FX29) && is(second, Opcode::CPU_DXYN) && second->n == 5)
+    {
+        return Fusion{Superinstruction::FontDraw, 2};
+    }
+
+    // FX07, 3X00, 1NNN with NNN pointing back to FX07
+    const auto third = instruction(2);
+    if (is(first, Opcode::CPU_FX07) && is(second, Opcode::CPU_3XNN) && is(third, Opcode::CPU_1NNN) &&
+        second->x == first->x && second->nn == 0 && third->nnn == address)
+    {
+        return Fusion{Superinstruction::DelayWait, 3};
+    }
+
+    // 6XNN, 6XNN, ...
+    if (is(first, Opcode::CPU_6XNN) && is(second, Opcode::CPU_6XNN))
+    {
+        uint8_t length = 2;
+        while (length < kMaxLoadRun && is(instruction(length), Opcode::CPU_6XNN))
+        {
+            length++;
+        }
+        return Fusion{Superinstruction::LoadRun, length};
+    }
+
+    return Fusion{};
+}
+
+uint64_t Chip8::runCached(uint64_t count)
+{
+    uint64_t executed = 0;
+    while (executed < count && state.isRunning && !state.waitingForKey)
+    {
+        const auto &fusion = fusions[state.instructionPointer & 0xFFF];
+
+        // Superinstructions may only run if all of their instructions fit into the budget
+        if (fusion.type != Superinstruction::None && fusion.length <= count - executed)
+        {
+            executed += executeFusion(fusion);
+
+            // There is no breakpoint inside a superinstruction, so only the exit has to be checked
+            if (!state.breakpoints.empty() &&
+                std::find(state.breakpoints.begin(), state.breakpoints.end(),
+                          state.instructionPointer) != state.breakpoints.end())
+            {
+                stop();
+            }
+        }
+        else
+        {
+            executeInstruction();
+            executed++;
+        }
+    }
+
+    return executed;
+}
+
+int Chip8::executeFusion(const Fusion &fusion)
+{
+    const auto address = state.instructionPointer;
+    const auto &first = instructionCache[address & 0xFFF];
+    const auto &second = instructionCache[(address + 2) & 0xFFF];
+
+    switch (fusion.type) {
+    case Superinstruction::LoadDraw:
+        state.I = first.nnn;
+        state.instructionPointer += 2 * sizeof(opcode);
+        CPU_DXYN(second);
+        return 2;
+    case Superinstruction::FontDraw:
+        state.I = state.V[first.x] * 0x5;
+        state.instructionPointer += 2 * sizeof(opcode);
+        CPU_DXYN(second);
+        return 2;
+    case Superinstruction::DelayWait:
+        // Either the loop is left by the skip or the jump leads back to the start
+        state.V[first.x] = state.delayTimer;
+        if (state.V[first.x] == 0)
+        {
+            state.instructionPointer += 3 * sizeof(opcode);
+            return 2;
+        }
+        return 3;
+    case Superinstruction::LoadRun:
+        for (int i = 0; i < fusion.length; i++)
+        {
+            const auto &op = instructionCache[(address + i * sizeof(opcode)) & 0xFFF];
+            state.V[op.x] = op.nn;
+        }
+        state.instructionPointer += fusion.length * sizeof(opcode);
+        return fusion.length;
+    case Superinstruction::None:
+        break;
+    }
+
+    return 0;
+}
@@ -0,0 +1,385 @@
+//--------------------------------------------------------------------------------------------------
+// Cross-Platform Chip-8 Emulator
+// Copyright (C) 2020 Enrico Schörnick
+// Licensed under the MIT License
+//--------------------------------------------------------------------------------------------------
+
+#include "chip8/Chip8.hpp"
+
+#include <bitset>
+#include <cstring>
+#include <cstdlib>
+
+/**
+ * Threaded interpreter variant of the Chip-8 core.
+ *
+ * V0-VF, I and the instruction pointer live in local variables for the whole
+ * run and every handler jumps directly to the handler of the next instruction.
+ * With GCC and Clang this uses computed goto, so every handler has its own
+ * indirect branch which the branch predictor can learn separately. Other
+ * compilers fall back to a switch inside a loop with the same semantics.
+ */
+
+#if defined(__GNUC__)
+#define CHIP8_COMPUTED_GOTO 1
+#endif
+
+// Defines that simplifiy opcode and register handling (locals instead of state)
+#define N (op.n)
+#define NN (op.nn)
+#define NNN (op.nnn)
+#define X (op.x)
+#define Y (op.y)
+#define VX V[op.x]
+#define VY V[op.y]
+
+#ifdef CHIP8_COMPUTED_GOTO
+// Labels as values are a GNU extension which is exactly what we want here
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+
+uint64_t Chip8::runThreaded(uint64_t count)
+{
+    if (!state.isRunning || state.waitingForKey || count == 0)
+    {
+        return 0;
+    }
+
+    // Copy hot registers into locals, they get written back on exit
+    auto V = state.V;
+    auto I = state.I;
+    auto pc = state.instructionPointer;
+
+    // Bitmap of all breakpoints so the check after every instruction is cheap
+    std::bitset<4096> breakpointMap;
+    for (const auto &breakpoint : state.breakpoints)
+    {
+        breakpointMap.set(breakpoint & 0xFFF);
+    }
+    const auto checkBreakpoints = breakpointMap.any();
+
+    uint64_t executed = 0;
+    MicroOp op{};
+
+    // Load registers from state after calling a member handler
+    auto load = [&]() {
+        V = state.V;
+        I = state.I;
+        pc = state.instructionPointer;
+    };
+
+    // Write registers back to state before calling a member handler
+    auto store = [&]() {
+        state.V = V;
+        state.I = I;
+        state.instructionPointer = pc;
+    };
+
+    // Fetch the predecoded instruction at pc and advance pc
+    auto fetch = [&]() {
+        op = instructionCache[pc & 0xFFF];
+        if (!op.valid)
+        {
+            op = fetchMicroOp(pc);
+        }
+        pc += sizeof(opcode);
+    };
+
+#ifdef CHIP8_COMPUTED_GOTO
+    static void *const labels[kOpcodeCount] = {
+        &&L_Invalid,
+        &&L_CPU_00E0, &&L_CPU_00EE, &&L_CPU_1NNN, &&L_CPU_2NNN, &&L_CPU_3XNN,
+        &&L_CPU_4XNN, &&L_CPU_5XY0, &&L_CPU_6XNN, &&L_CPU_7XNN, &&L_CPU_8XY0,
+        &&L_CPU_8XY1, &&L_CPU_8XY2, &&L_CPU_8XY3, &&L_CPU_8XY4, &&L_CPU_8XY5,
+        &&L_CPU_8XY6, &&L_CPU_8XY7, &&L_CPU_8XYE, &&L_CPU_9XY0, &&L_CPU_ANNN,
+        &&L_CPU_BNNN, &&L_CPU_CXNN, &&L_CPU_DXYN, &&L_CPU_EX9E, &&L_CPU_EXA1,
+        &&L_CPU_FX07, &&L_CPU_FX0A, &&L_CPU_FX15, &&L_CPU_FX18, &&L_CPU_FX1E,
+        &&L_CPU_FX29, &&L_CPU_FX33, &&L_CPU_FX55, &&L_CPU_FX65};
+
+#define HANDLER(name) L_##name:
+#define DISPATCH()                                                      \
+    executed++;                                                         \
+    if (checkBreakpoints && breakpointMap[pc & 0xFFF])                  \
+    {                                                                   \
+        state.isRunning = false;                                        \
+        goto exit;                                                      \
+    }                                                                   \
+    if (executed == count)                                              \
+    {                                                                   \
+        goto exit;                                                      \
+    }                                                                   \
+    fetch();                                                            \
+    goto *labels[static_cast<size_t>(op.type)]
+
+    fetch();
+    goto *labels[static_cast<size_t>(op.type)];
+#else
+#define HANDLER(name) case Opcode::name:
+#define DISPATCH()                                                      \
+    executed++;                                                         \
+    if (checkBreakpoints && breakpointMap[pc & 0xFFF])                  \
+    {                                                                   \
+        state.isRunning = false;                                        \
+        goto exit;                                                      \
+    }                                                                   \
+    if (executed == count)                                              \
+    {                                                                   \
+        goto exit;                                                      \
+    }                                                                   \
+    continue
+
+    for (;;)
+    {
+        fetch();
+        switch (op.type) {
+#endif
+
+    HANDLER(Invalid)
+    {
+        // Unknown opcodes get ignored, just like in the switch decoder
+        DISPATCH();
+    }
+
+    HANDLER(CPU_00E0)
+    {
+        state.display.fill(0);
+        DISPATCH();
+    }
+
+    HANDLER(CPU_00EE)
+    {
+        state.stackPointer--;
+        pc = state.stack[state.stackPointer];
+        DISPATCH();
+    }
+
+    HANDLER(CPU_1NNN)
+    {
+        pc = NNN;
+        DISPATCH();
+    }
+
+    HANDLER(CPU_2NNN)
+    {
+        state.stack[state.stackPointer] = pc;
+        state.stackPointer++;
+        pc = NNN;
+        DISPATCH();
+    }
+
+    HANDLER(CPU_3XNN)
+    {
+        pc += (VX == NN) ? sizeof(opcode) : 0;
+        DISPATCH();
+    }
+
+    HANDLER(CPU_4XNN)
+    {
+        pc += (VX != NN) ? sizeof(opcode) : 0;
+        DISPATCH();
+    }
+
+    HANDLER(CPU_5XY0)
+    {
+        pc += (VX == VY) ? sizeof(opcode) : 0;
+        DISPATCH();
+    }
+
+    HANDLER(CPU_6XNN)
+    {
+        VX = NN;
+        DISPATCH();
+    }
+
+    HANDLER(CPU_7XNN)
+    {
+        VX += NN;
+        DISPATCH();
+    }
+
+    HANDLER(CPU_8XY0)
+    {
+        VX = VY;
+        DISPATCH();
+    }
+
+    HANDLER(CPU_8XY1)
+    {
+        VX |= VY;
+        DISPATCH();
+    }
+
+    HANDLER(CPU_8XY2)
+    {
+        VX &= VY;
+        DISPATCH();
+    }
+
+    HANDLER(CPU_8XY3)
+    {
+        VX ^= VY;
+        DISPATCH();
+    }
+
+    HANDLER(CPU_8XY4)
+    {
+        V[0xF] = (VY > (0xFF - VX)) ? 1 : 0;
+        VX += VY;
+        DISPATCH();
+    }
+
+    HANDLER(CPU_8XY5)
+    {
+        V[0xF] = (VY > VX) ? 0 : 1;
+        VX -= VY;
+        DISPATCH();
+    }
+
+    HANDLER(CPU_8XY6)
+    {
+        V[0xF] = VX & 0x1;
+        VX >>= 1;
+        DISPATCH();
+    }
+
+    HANDLER(CPU_8XY7)
+    {
+        V[0xF] = (VX > VY) ? 0 : 1;
+        VX = VY - VX;
+        DISPATCH();
+    }
+
+    HANDLER(CPU_8XYE)
+    {
+        V[0xF] = VX >> 7;
+        VX <<= 1;
+        DISPATCH();
+    }
+
+    HANDLER(CPU_9XY0)
+    {
+        pc += (VX != VY) ? sizeof(opcode) : 0;
+        DISPATCH();
+    }
+
+    HANDLER(CPU_ANNN)
+    {
+        I = NNN;
+        DISPATCH();
+    }
+
+    HANDLER(CPU_BNNN)
+    {
+        pc = NNN + V[0];
+        DISPATCH();
+    }
+
+    HANDLER(CPU_CXNN)
+    {
+        VX = NN & (nextRandom() % 0xFF);
+        DISPATCH();
+    }
+
+    HANDLER(CPU_DXYN)
+    {
+        // Sprite drawing is expensive anyway, so reuse the member handler
+        store();
+        CPU_DXYN(op);
+        load();
+        DISPATCH();
+    }
+
+    HANDLER(CPU_EX9E)
+    {
+        pc += state.keypad[VX] ? sizeof(opcode) : 0;
+        DISPATCH();
+    }
+
+    HANDLER(CPU_EXA1)
+    {
+        pc += !(state.keypad[VX]) ? sizeof(opcode) : 0;
+        DISPATCH();
+    }
+
+    HANDLER(CPU_FX07)
+    {
+        VX = state.delayTimer;
+        DISPATCH();
+    }
+
+    HANDLER(CPU_FX0A)
+    {
+        store();
+        CPU_FX0A(op);
+        load();
+
+        // Without a key the machine parks, nothing runs until the next press
+        if (state.waitingForKey)
+        {
+            executed++;
+            goto exit;
+        }
+        DISPATCH();
+    }
+
+    HANDLER(CPU_FX15)
+    {
+        state.delayTimer = VX;
+        DISPATCH();
+    }
+
+    HANDLER(CPU_FX18)
+    {
+        state.soundTimer = VX;
+        DISPATCH();
+    }
+
+    HANDLER(CPU_FX1E)
+    {
+        V[0xF] = (I + VX > 0xFFF) ? 1 : 0;
+        I += VX;
+        DISPATCH();
+    }
+
+    HANDLER(CPU_FX29)
+    {
+        I = VX * 0x5;
+        DISPATCH();
+    }
+
+    HANDLER(CPU_FX33)
+    {
+        state.memory[I] = VX / 100;
+        state.memory[I + 1] = (VX / 10) % 10;
+        state.memory[I + 2] = (VX % 100) % 10;
+        invalidateInstructions(I, 3);
+        DISPATCH();
+    }
+
+    HANDLER(CPU_FX55)
+    {
+        memcpy(state.memory.data() + I, V.data(), X + 1);
+        invalidateInstructions(I, X + 1);
+        DISPATCH();
+    }
+
+    HANDLER(CPU_FX65)
+    {
+        memcpy(V.data(), state.memory.data() + I, X + 1);
+        DISPATCH();
+    }
+
+#ifndef CHIP8_COMPUTED_GOTO
+        }
+    }
+#endif
+
+exit:
+    store();
+    return executed;
+}
+
+#ifdef CHIP8_COMPUTED_GOTO
+#pragma GCC diagnostic pop
+#endif
@@ -16,6 +16,8 @@
 #include "chip8/sections/DisplaySection.hpp"
 
 #include <string>
+#include <sstream>
+#include <iomanip>
 #include <iostream>
 #include <algorithm>
 
@@ -36,6 +38,13 @@ bool UserInterface::initialize()
     soundManager = std::make_unique<SoundManager>();
     memoryDumper = std::make_unique<MemoryDumper>();
     renderManager = std::make_unique<RenderManager>(renderer);
+    rewindBuffer = std::make_unique<RewindBuffer>();
+    rewindState = std::make_unique<MachineState>();
+    emulation = std::make_unique<EmulationThread>(chip8);
+    emulation->getView(view);
+#ifdef CHIP8_PROFILE
+    emulation->post([this](Chip8 &chip8) { chip8.setProfiler(&profiler); });
+#endif
 
     // Add all desired sections to the section list
     sections.emplace_back(std::make_unique<InfoSection>(renderManager));
@@ -58,7 +67,7 @@ bool UserInterface::initializeWindow()
     }
 
     // Create our main window
-    window = SDL_CreateWindow("Chip-8 Emulator",
+    window = SDL_CreateWindow(kWindowTitle,
                               SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
                               Layout::MainWindow::width, Layout::MainWindow::height,
                               SDL_WINDOW_SHOWN);
@@ -93,46 +102,60 @@ bool UserInterface::initializeWindow()
 
 void UserInterface::run()
 {
-    chip8.start();
+    emulation->post([](Chip8 &chip8) { chip8.start(); });
+    emulation->start();
     startRedrawTimer();
-    startEmulatorTimer();
 
+    // Nothing to do between the events, emulation has its own thread
     SDL_Event event;
-    auto &state = chip8.getState();
     auto running = true;
 
-    while (running)
+    while (running && SDL_WaitEvent(&event))
     {
-        while (SDL_PollEvent(&event))
+        if (event.type == SDL_USEREVENT)
         {
-            if (event.type == SDL_USEREVENT)
-            {
-                handleTimerEvent(event, state);
-            }
-            else if (event.type == SDL_KEYDOWN | event.type == SDL_KEYUP)
-            {
-                handleInputEvent(event, state);
-            }
-            else if (event.type == SDL_DROPFILE)
-            {
-                handleDropEvent(event);
-            }
-            else if (event.type == SDL_QUIT)
-            {
-                running = false;
-            }
+            handleTimerEvent(event);
+        }
+        else if (event.type == SDL_KEYDOWN | event.type == SDL_KEYUP)
+        {
+            handleInputEvent(event);
+        }
+        else if (event.type == SDL_DROPFILE)
+        {
+            handleDropEvent(event);
+        }
+        else if (event.type == SDL_QUIT)
+        {
+            running = false;
         }
     }
+
+    stopTimer(redrawTimerId);
+    emulation->stop();
+
+    if (movie && movie->save(moviePath))
+    {
+        std::cout << "Info: Input movie saved to " << moviePath << std::endl;
+    }
+
+#ifdef CHIP8_PROFILE
+    saveProfile(chip8.getState());
+#endif
 }
 
-void UserInterface::startRedrawTimer()
+void UserInterface::startRecording(const std::string &path)
 {
-    redrawTimerId = SDL_AddTimer(kRedrawInterval, timerCallback, nullptr);
+    // The emulation thread isn't running yet, so the state can be read directly
+    const auto &state = chip8.getState();
+    movie = std::make_unique<InputMovie>();
+    movie->startRecording(state, state.game->name);
+    moviePath = path;
+    emulation->setMovie(movie.get());
 }
 
-void UserInterface::startEmulatorTimer()
+void UserInterface::startRedrawTimer()
 {
-    emulatorTimerId = SDL_AddTimer(kCatchUpInterval, timerCallback, nullptr);
+    redrawTimerId = SDL_AddTimer(kRedrawInterval, timerCallback, nullptr);
 }
 
 void UserInterface::stopTimer(SDL_TimerID timerId)
@@ -140,64 +163,67 @@ void UserInterface::stopTimer(SDL_TimerID timerId)
     SDL_RemoveTimer(timerId);
 }
 
-void UserInterface::handleTimerEvent(SDL_Event &event, const Chip8State &state)
+void UserInterface::handleTimerEvent(SDL_Event &event)
 {
-    if (event.user.code == kRedrawEvent)
+    if (event.user.code != kRedrawEvent)
     {
-        chip8.updateTimers();
-        soundManager->playSound(state.soundTimer > 0);
-        updateScreen();
-
-        /**
-         * If we are in warp mode we need to warp between the draw calls.
-         * If not we can sleep for a bit so the cpu isn't working all the time.
-         */
-        if (warpMode)
-        {
-            warp();
-        }
-        else
+        return;
+    }
+
+    const auto newFrame = emulation->getView(view);
+
+    // While rewinding every redraw steps back by one recorded frame
+    if (rewinding)
+    {
+        if (rewindBuffer->stepBack(*rewindState))
         {
-            SDL_Delay(10);
+            emulation->post([snapshot = *rewindState](Chip8 &chip8) { chip8.loadState(snapshot); });
         }
     }
-    else if (event.user.code == kCatchUpEvent && state.isRunning)
+    else if (newFrame && view.isRunning)
     {
-        chip8.catchUp();
+        rewindBuffer->push(emulation->getFrame());
     }
+
+    soundManager->playSound(view.soundTimer > 0);
+    updateScreen();
+    updateTitle();
 }
 
-void UserInterface::handleInputEvent(SDL_Event &event, const Chip8State &state)
+void UserInterface::handleInputEvent(SDL_Event &event)
 {
     /**
      * Here we handle user input. It's a bit messy but I haven't figured
-     * out a nicer way of doing it yet.
+     * out a nicer way of doing it yet. Everything which changes the
+     * emulator runs on the emulation thread.
      */
     const auto &key = event.key.keysym.sym;
     const auto pressed = (event.type == SDL_KEYDOWN);
 
     if (key == SDLK_F1 && pressed)
     {
-        if (state.isRunning)
+        if (view.isRunning && warpMode)
         {
-            chip8.stop();
-            if (warpMode)
+            stopWarpMode();
+        }
+        emulation->post([](Chip8 &chip8) {
+            if (chip8.getState().isRunning)
             {
-                stopWarpMode();
+                chip8.stop();
             }
-        }
-        else
-        {
-            chip8.start();
-        }
+            else
+            {
+                chip8.start();
+            }
+        });
     }
-    else if (key == SDLK_F2 && pressed && !state.isRunning)
+    else if (key == SDLK_F2 && pressed && !view.isRunning)
     {
-        chip8.emulateCycle();
+        emulation->post([](Chip8 &chip8) { chip8.emulateCycle(); });
     }
     else if (key == SDLK_F3 && pressed)
     {
-        chip8.toggleBreakpoint();
+        emulation->post([](Chip8 &chip8) { chip8.toggleBreakpoint(); }, true);
     }
     else if (key == SDLK_F4 && pressed)
     {
@@ -212,22 +238,42 @@ void UserInterface::handleInputEvent(SDL_Event &event, const Chip8State &state)
     }
     else if (key == SDLK_F5 && pressed)
     {
-        memoryDumper->dumpMemory(state.memory);
+        memoryDumper->dumpMemory(view.memory);
     }
     else if (key == SDLK_F6 && pressed)
     {
-        if (chip8.loadGame(state.game->path) && warpMode)
+        loadGame(view.game->path);
+    }
+#ifdef CHIP8_PROFILE
+    else if (key == SDLK_F7 && pressed)
+    {
+        // The profiler belongs to the emulation thread while it runs
+        emulation->post([this](Chip8 &chip8) { saveProfile(chip8.getState()); });
+    }
+#endif
+    else if (key == SDLK_BACKSPACE)
+    {
+        // A recording has to stay one continuous run
+        if (pressed && movie)
         {
-            stopWarpMode();
+            std::cout << "Info: Rewinding isn't possible while an input movie gets recorded" << std::endl;
+        }
+        else if (pressed && !rewinding)
+        {
+            startRewind();
+        }
+        else if (!pressed && rewinding)
+        {
+            stopRewind();
         }
     }
     else if (key == SDLK_PLUS && pressed)
     {
-        chip8.increaseSpeed();
+        emulation->post([](Chip8 &chip8) { chip8.increaseSpeed(); });
     }
     else if (key == SDLK_MINUS && pressed)
     {
-        chip8.decreaseSpeed();
+        emulation->post([](Chip8 &chip8) { chip8.decreaseSpeed(); });
     }
     else
     {
@@ -235,54 +281,80 @@ void UserInterface::handleInputEvent(SDL_Event &event, const Chip8State &state)
         auto index = std::find_if(keyMap.begin(), keyMap.end(),
                                   [&](const auto &x) { return x.first == key; });
 
-        // If the key is in the keymap we inform the chip-8
-        if (index != keyMap.end())
+        // If the key is in the keymap we inform the chip-8, key repeats change nothing
+        if (index != keyMap.end() && event.key.repeat == 0 && !emulation->pushInput(pressed, index->second))
         {
-            chip8.setButton(pressed, index->second);
+            std::cout << "Error: Input queue is full, key dropped" << std::endl;
         }
     }
 }
 
 void UserInterface::handleDropEvent(SDL_Event &event)
 {
-    std::string path(event.drop.file);
-    if (chip8.loadGame(path) && warpMode)
+    loadGame(event.drop.file);
+    SDL_free(event.drop.file);
+}
+
+void UserInterface::loadGame(const std::string &path)
+{
+    emulation->post([this, path](Chip8 &chip8) {
+        // A recording always covers the game which is currently loaded
+        if (chip8.loadGame(path) && movie)
+        {
+            movie->startRecording(chip8.getState(), chip8.getState().game->name);
+        }
+    }, true);
+
+    rewindBuffer->clear();
+    if (warpMode)
     {
         stopWarpMode();
     }
-    SDL_free(event.drop.file);
 }
 
 void UserInterface::startWarpMode()
 {
     warpMode = true;
-    chip8.start();
-    stopTimer(emulatorTimerId);
+    emulation->setWarpMode(true);
 }
 
 void UserInterface::stopWarpMode()
 {
     warpMode = false;
-    startEmulatorTimer();
+    emulation->setWarpMode(false);
+    SDL_SetWindowTitle(window, kWindowTitle);
 }
 
-void UserInterface::warp()
+void UserInterface::startRewind()
 {
-    static auto counter = 0;
-    static auto executedInstructions = 0;
-
-    executedInstructions += chip8.executeMs(16);
-    counter++;
+    rewinding = true;
+    resumeAfterRewind = view.isRunning;
+    emulation->post([](Chip8 &chip8) { chip8.stop(); });
+    if (warpMode)
+    {
+        stopWarpMode();
+    }
+}
 
-    // After looping 62 times for 16 ms we have 1 second and can print the result
-    if (counter >= 62)
+void UserInterface::stopRewind()
+{
+    // Recording continues from the restored frame, the frames after it are gone
+    rewinding = false;
+    if (resumeAfterRewind)
     {
-        std::cout << "Instructions per second: " << executedInstructions << std::endl;
-        counter = 0;
-        executedInstructions = 0;
+        emulation->post([](Chip8 &chip8) { chip8.start(); });
     }
 }
 
+#ifdef CHIP8_PROFILE
+void UserInterface::saveProfile(const Chip8State &state)
+{
+    profiler.save(kProfilePath);
+    profiler.saveHotSpots(kHotSpotPath, state);
+    profiler.saveCoverage(kCoveragePath, state);
+}
+#endif
+
 uint32_t UserInterface::timerCallback(uint32_t interval, void *param)
 {
     /**
@@ -293,7 +365,7 @@ uint32_t UserInterface::timerCallback(uint32_t interval, void *param)
     SDL_UserEvent userevent;
 
     userevent.type = SDL_USEREVENT;
-    userevent.code = (interval == kRedrawInterval) ? kRedrawEvent : kCatchUpEvent;
+    userevent.code = kRedrawEvent;
 
     event.type = SDL_USEREVENT;
     event.user = userevent;
@@ -306,7 +378,23 @@ void UserInterface::updateScreen()
 {
     for (const auto &section : sections)
     {
-        section->redraw(chip8.getState());
+        section->redraw(view);
     }
     renderManager->updateScreen();
-}
\ No newline at end of file
+}
+
+void UserInterface::updateTitle()
+{
+    // Warp speed shows up in the title, the stats change once per second
+    const auto stats = emulation->getStats();
+    if (!warpMode || stats.instructions == titleInstructions)
+    {
+        return;
+    }
+    titleInstructions = stats.instructions;
+
+    std::stringstream title;
+    title << kWindowTitle << " - Warp " << std::fixed << std::setprecision(1) << stats.speed << "x ("
+          << std::setprecision(2) << stats.instructionsPerSecond / 1000000.0 << " MIPS)";
+    SDL_SetWindowTitle(window, title.str().c_str());
+}
@@ -26,30 +26,26 @@ void CodeSection::renderCode(const Chip8State &state)
 {
     // Aliases
     const auto &instructionPointer = state.instructionPointer;
-    const auto &disassembly = state.disassembly;
     const auto &startAddress = state.kStartAddress;
     const auto &breakpoints = state.breakpoints;
 
-    const size_t maxLines = 25;
-    const auto instructionSize = 2;
+    // The listing ends with the game, unless the game runs code behind it
+    const auto gameEnd = startAddress + (state.game ? static_cast<int>(state.game->size) : 0);
+    const auto endAddress = std::min(std::max(gameEnd, instructionPointer + kInstructionSize), 0x1000);
 
-    // Check whether code window should be moved (and if so, adapt bottom and top addresses)
-    if (instructionPointer < topInstruction || instructionPointer > bottomInstruction)
+    // The window only moves once the executed instruction isn't one of its lines anymore.
+    // Code can run at odd addresses too, then the listing has to follow that stream instead.
+    layoutLines(state, endAddress);
+    if (std::find(lines.begin(), lines.begin() + lineCount, instructionPointer) == lines.begin() + lineCount)
     {
         topInstruction = instructionPointer;
-        bottomInstruction = topInstruction + (maxLines - 1) * instructionSize;
+        layoutLines(state, endAddress);
     }
 
-    // Index of topInstruction in disassembly vector
-    const auto instructionIndex = std::max((topInstruction - startAddress) / instructionSize, 0);
-
-    // Determine if we can print maxLines or less
-    const auto numCodeLines = std::min((disassembly.size() - instructionIndex), maxLines);
-
-    for (int i = 0; i < numCodeLines; ++i)
+    for (int i = 0; i < lineCount; ++i)
     {
-        auto address = topInstruction + i * instructionSize;
-        auto yShift = i * Char::lineHeight;
+        const auto address = lines[i];
+        const auto yShift = i * Char::lineHeight;
 
         // Box the currently executed instruction with a red outline
         if (address == instructionPointer)
@@ -61,7 +57,26 @@ void CodeSection::renderCode(const Chip8State &state)
         auto padding = Box::outlineThickness + Box::padding;
         auto printRed = std::count(breakpoints.begin(), breakpoints.end(), address) > 0;
 
+        // Lines get decoded again as soon as a write changed one of their two bytes
         renderManager->render(TextWidget{CodeBox::xPos + padding, CodeBox::yPos + yShift + padding,
-                                         disassembly.at(instructionIndex + i), printRed});
+                                         disassembler->getLine(state.memory, address, roles[i]), printRed});
     }
-}
\ No newline at end of file
+}
+
+void CodeSection::layoutLines(const Chip8State &state, int endAddress)
+{
+    // Sprites show up as data and subroutines get marked, the executed instruction is code in any case
+    auto address = topInstruction;
+    for (lineCount = 0; lineCount < kMaxLines && address < endAddress; lineCount++)
+    {
+        auto role = state.controlFlow ? state.controlFlow->getRole(address) : Disassembler::Role::Code;
+        if (address == state.instructionPointer && role != Disassembler::Role::Subroutine)
+        {
+            role = Disassembler::Role::Code;
+        }
+
+        lines[lineCount] = address;
+        roles[lineCount] = role;
+        address += (role == Disassembler::Role::Byte) ? 1 : kInstructionSize;
+    }
+}
@@ -29,7 +29,7 @@ void DisplaySection::renderDisplay(const Chip8State &state) const
             renderManager->render(PixelWidget{x * DisplayBox::scale + DisplayBox::displayX,
                                               y * DisplayBox::scale + DisplayBox::displayY,
                                               DisplayBox::scale,
-                                              state.display[(y * state.kHorizontalRes) + x]});
+                                              state.getPixel(x, y)});
         }
     }
 }
\ No newline at end of file
@@ -0,0 +1,239 @@
+//--------------------------------------------------------------------------------------------------
+// Cross-Platform Chip-8 Emulator
+// Copyright (C) 2020 Enrico Schörnick
+// Licensed under the MIT License
+//--------------------------------------------------------------------------------------------------
+
+/**
+ * chip8_test: Headless checks of the emulator core, run by ctest. Every check
+ * prints what differs and fails with it:
+ *  movie    - an input movie recorded with the cached decoder replays to the
+ *             same state with every decoder
+ *  lockstep - batch runs in lockstep engines end in the same state as the
+ *             same runs on single instances
+ *  wait     - a key press from the input queue wakes a machine parked on FX0A,
+ *             even if it is stamped with a later instruction count
+ *
+ * Usage: chip8_test <movie|lockstep|wait> <games directory>
+ */
+
+#include "chip8/Chip8.hpp"
+#include "chip8/InputQueue.hpp"
+#include "chip8/InputMovie.hpp"
+#include "chip8/BatchRunner.hpp"
+
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <filesystem>
+
+namespace
+{
+    const Decoder kDecoders[] = {Decoder::Switch, Decoder::Table, Decoder::Cached,
+                                 Decoder::Threaded, Decoder::Jit, Decoder::Aot};
+
+    // Random numbers, timers, FX0A and a lot of key input
+    const char *const kGames[] = {"Brix", "Clock", "Cavern", "RandomTest", "Tetris", "Wall"};
+
+    const int kFrames{1200};
+
+    bool isSameMachine(const MachineState &a, const MachineState &b)
+    {
+        return a.instructionCount == b.instructionCount && a.instructionPointer == b.instructionPointer &&
+               a.I == b.I && a.V == b.V && a.stackPointer == b.stackPointer && a.stack == b.stack &&
+               a.delayTimer == b.delayTimer && a.soundTimer == b.soundTimer && a.random == b.random &&
+               a.waitingForKey == b.waitingForKey && a.display == b.display && a.memory == b.memory;
+    }
+
+    bool checkMovie(const std::filesystem::path &games)
+    {
+        const auto moviePath = std::filesystem::temp_directory_path() / "chip8_test.mov";
+        auto passed = true;
+
+        for (const auto *game : kGames)
+        {
+            const auto gamePath = (games / (std::string(game) + ".ch8")).string();
+
+            Chip8 recorder;
+            if (!recorder.loadGame(gamePath))
+            {
+                return false;
+            }
+
+            InputMovie movie;
+            movie.startRecording(recorder.getState(), game);
+            recorder.setMovie(&movie);
+            recorder.start();
+
+            // Keys get pressed in the middle of frames as well, that's where the user interface delivers them
+            for (int frame = 0; frame < kFrames; frame++)
+            {
+                if (frame % 37 == 5)
+                {
+                    recorder.setButton(true, (frame / 37) % 16);
+                }
+                if (frame % 37 == 9)
+                {
+                    recorder.setButton(false, (frame / 37) % 16);
+                }
+                recorder.runFrame();
+            }
+            recorder.setMovie(nullptr);
+
+            if (!movie.save(moviePath.string()))
+            {
+                return false;
+            }
+
+            for (auto decoder : kDecoders)
+            {
+                Chip8 player;
+                player.setDecoder(decoder);
+                InputMovie replay;
+                if (!player.loadGame(gamePath) || !replay.load(moviePath.string()))
+                {
+                    return false;
+                }
+
+                if (!replay.replay(player) || !isSameMachine(player.getState(), recorder.getState()))
+                {
+                    std::cout << "Error: Replay of " << game << " differs with the " << getDecoderName(decoder)
+                              << " decoder" << std::endl;
+                    passed = false;
+                }
+            }
+        }
+
+        std::filesystem::remove(moviePath);
+        return passed;
+    }
+
+    bool checkLockstep(const std::filesystem::path &games)
+    {
+        std::vector<BatchJob> jobs;
+        for (const auto *game : kGames)
+        {
+            // Lanes with different keys and seeds diverge and have to meet again
+            for (int key = 0; key < 4; key++)
+            {
+                for (uint32_t seed = 1; seed <= 4; seed++)
+                {
+                    BatchJob job;
+                    job.gamePath = (games / (std::string(game) + ".ch8")).string();
+                    job.frames = kFrames;
+                    job.seed = seed;
+                    for (uint64_t frame = 0; frame < job.frames; frame += 10)
+                    {
+                        const auto keys = ((frame / 10) % 2 == 0) ? (1 << (key * 2)) : 0;
+                        job.inputs.push_back(BatchInput{frame, static_cast<uint16_t>(keys)});
+                    }
+                    jobs.push_back(job);
+                }
+            }
+        }
+
+        BatchRunner scalar;
+        const auto expected = scalar.run(jobs);
+
+        BatchRunner lockstep;
+        lockstep.setLockstep(true);
+        const auto results = lockstep.run(jobs);
+
+        auto passed = true;
+        for (size_t i = 0; i < jobs.size(); i++)
+        {
+            const auto &a = expected[i];
+            const auto &b = results[i];
+            if (!a.loaded || !b.loaded || a.instructions != b.instructions || a.displayHash != b.displayHash ||
+                a.framesHash != b.framesHash || a.V != b.V || a.I != b.I ||
+                a.instructionPointer != b.instructionPointer || a.stackPointer != b.stackPointer)
+            {
+                std::cout << "Error: Lockstep run of " << std::filesystem::path(jobs[i].gamePath).filename().string()
+                          << " with seed " << jobs[i].seed << " differs from the single instance" << std::endl;
+                passed = false;
+            }
+        }
+        return passed;
+    }
+
+    bool checkWait()
+    {
+        // FX0A into V3, then loop forever
+        const auto gamePath = std::filesystem::temp_directory_path() / "chip8_test_wait.ch8";
+        {
+            std::ofstream game(gamePath, std::ios::binary);
+            game.write("\xF3\x0A\x12\x02", 4);
+        }
+
+        auto passed = true;
+        for (auto decoder : kDecoders)
+        {
+            Chip8 chip8;
+            InputQueue queue;
+            chip8.setInputQueue(&queue);
+            chip8.setDecoder(decoder);
+            if (!chip8.loadGame(gamePath.string()))
+            {
+                return false;
+            }
+            chip8.start();
+            chip8.runFrame();
+
+            const auto &state = chip8.getState();
+            if (!state.waitingForKey)
+            {
+                std::cout << "Error: FX0A didn't wait for a key with the " << getDecoderName(decoder) << " decoder"
+                          << std::endl;
+                passed = false;
+                continue;
+            }
+
+            // The frontend stamps presses with the count it expects the machine to reach, parked it never does
+            queue.push(InputEvent{state.instructionCount + 1000, 0x7, true});
+            const auto executed = chip8.runFrame();
+            if (state.waitingForKey || state.V[0x3] != 0x7 || executed == 0)
+            {
+                std::cout << "Error: Queued key press didn't end FX0A with the " << getDecoderName(decoder)
+                          << " decoder" << std::endl;
+                passed = false;
+            }
+        }
+
+        std::filesystem::remove(gamePath);
+        return passed;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3)
+    {
+        std::cout << "Usage: chip8_test <movie|lockstep|wait> <games directory>" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const std::string check(argv[1]);
+    const std::filesystem::path games(argv[2]);
+
+    auto passed = false;
+    if (check == "movie")
+    {
+        passed = checkMovie(games);
+    }
+    else if (check == "lockstep")
+    {
+        passed = checkLockstep(games);
+    }
+    else if (check == "wait")
+    {
+        passed = checkWait();
+    }
+    else
+    {
+        std::cout << "Error: Unknown check " << check << std::endl;
+    }
+
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
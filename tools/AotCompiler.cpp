@@ -0,0 +1,305 @@
+//--------------------------------------------------------------------------------------------------
+// Cross-Platform Chip-8 Emulator
+// Copyright (C) 2020 Enrico Schörnick
+// Licensed under the MIT License
+//--------------------------------------------------------------------------------------------------
+
+/**
+ * chip8_aot: Ahead of time compiler which translates a Chip-8 game into a C++
+ * translation unit with one function per discovered code block. The generated
+ * code works directly on Chip8State and registers itself at startup, so every
+ * executable it gets linked into runs the game natively (Aot decoder).
+ *
+ * Usage: chip8_aot <game.ch8> <output.cpp>
+ */
+
+#include "chip8/Opcode.hpp"
+
+#include <map>
+#include <deque>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <filesystem>
+
+namespace
+{
+    const uint16_t kStartAddress{0x200};
+    const int kMaxBlockLength{64};
+
+    struct Block
+    {
+        uint16_t start;
+        uint16_t end;
+        int length;
+        std::vector<std::string> lines;
+    };
+
+    std::string hex(int value)
+    {
+        std::stringstream stream;
+        stream << "0x" << std::uppercase << std::hex << std::setw(3) << std::setfill('0') << value;
+        return stream.str();
+    }
+
+    std::string reg(int index)
+    {
+        return "s.V[" + std::to_string(index) + "]";
+    }
+
+    bool isTerminator(Opcode type)
+    {
+        switch (type) {
+        case Opcode::CPU_00EE:
+        case Opcode::CPU_1NNN:
+        case Opcode::CPU_2NNN:
+        case Opcode::CPU_3XNN:
+        case Opcode::CPU_4XNN:
+        case Opcode::CPU_5XY0:
+        case Opcode::CPU_9XY0:
+        case Opcode::CPU_BNNN:
+        case Opcode::CPU_EX9E:
+        case Opcode::CPU_EXA1:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    // C++ statements for one instruction, the semantics follow the handlers in Chip8.cpp
+    std::string translate(const MicroOp &op, uint16_t opcode, uint16_t next)
+    {
+        const auto vx = reg(op.x);
+        const auto vy = reg(op.y);
+        const auto vf = reg(0xF);
+        const auto nn = std::to_string(op.nn);
+        const auto skip = hex(next + 2);
+
+        switch (op.type) {
+        case Opcode::Invalid:  return "// Unknown opcode " + hex(opcode);
+        case Opcode::CPU_00EE: return "s.stackPointer--; return s.stack[s.stackPointer];";
+        case Opcode::CPU_1NNN: return "return " + hex(op.nnn) + ";";
+        case Opcode::CPU_2NNN: return "s.stack[s.stackPointer] = " + hex(next) + "; s.stackPointer++; return " + hex(op.nnn) + ";";
+        case Opcode::CPU_3XNN: return "return (" + vx + " == " + nn + ") ? " + skip + " : " + hex(next) + ";";
+        case Opcode::CPU_4XNN: return "return (" + vx + " != " + nn + ") ? " + skip + " : " + hex(next) + ";";
+        case Opcode::CPU_5XY0: return "return (" + vx + " == " + vy + ") ? " + skip + " : " + hex(next) + ";";
+        case Opcode::CPU_6XNN: return vx + " = " + nn + ";";
+        case Opcode::CPU_7XNN: return vx + " += " + nn + ";";
+        case Opcode::CPU_8XY0: return vx + " = " + vy + ";";
+        case Opcode::CPU_8XY1: return vx + " |= " + vy + ";";
+        case Opcode::CPU_8XY2: return vx + " &= " + vy + ";";
+        case Opcode::CPU_8XY3: return vx + " ^= " + vy + ";";
+        case Opcode::CPU_8XY4: return vf + " = (" + vy + " > (0xFF - " + vx + ")) ? 1 : 0; " + vx + " += " + vy + ";";
+        case Opcode::CPU_8XY5: return vf + " = (" + vy + " > " + vx + ") ? 0 : 1; " + vx + " -= " + vy + ";";
+        case Opcode::CPU_8XY6: return vf + " = " + vx + " & 0x1; " + vx + " >>= 1;";
+        case Opcode::CPU_8XY7: return vf + " = (" + vx + " > " + vy + ") ? 0 : 1; " + vx + " = " + vy + " - " + vx + ";";
+        case Opcode::CPU_8XYE: return vf + " = " + vx + " >> 7; " + vx + " <<= 1;";
+        case Opcode::CPU_9XY0: return "return (" + vx + " != " + vy + ") ? " + skip + " : " + hex(next) + ";";
+        case Opcode::CPU_ANNN: return "s.I = " + hex(op.nnn) + ";";
+        case Opcode::CPU_BNNN: return "return " + hex(op.nnn) + " + s.V[0];";
+        case Opcode::CPU_EX9E: return "return s.keypad[" + vx + "] ? " + skip + " : " + hex(next) + ";";
+        case Opcode::CPU_EXA1: return "return !s.keypad[" + vx + "] ? " + skip + " : " + hex(next) + ";";
+        case Opcode::CPU_FX07: return vx + " = s.delayTimer;";
+        case Opcode::CPU_FX15: return "s.delayTimer = " + vx + ";";
+        case Opcode::CPU_FX18: return "s.soundTimer = " + vx + ";";
+        case Opcode::CPU_FX1E: return vf + " = (s.I + " + vx + " > 0xFFF) ? 1 : 0; s.I += " + vx + ";";
+        case Opcode::CPU_FX29: return "s.I = " + vx + " * 0x5;";
+        default:
+            // Display, random numbers and memory transfers stay with the interpreter handlers
+            return "c.execute(c.chip8, " + hex(opcode) + ");";
+        }
+    }
+
+    /**
+     * Discover all code reachable from the start address by following jumps,
+     * calls and skips. Indirect jumps (BNNN) and returns end a path, their
+     * targets are handled by the interpreter at runtime.
+     */
+    std::vector<Block> discoverBlocks(const std::vector<uint8_t> &memory, uint16_t romEnd)
+    {
+        std::map<uint16_t, Block> blocks;
+        std::deque<uint16_t> worklist{kStartAddress};
+
+        auto enqueue = [&](uint16_t address) {
+            if (address >= kStartAddress && address + 1 < romEnd && blocks.count(address) == 0)
+            {
+                worklist.push_back(address);
+            }
+        };
+
+        while (!worklist.empty())
+        {
+            auto start = worklist.front();
+            worklist.pop_front();
+            if (blocks.count(start) != 0)
+            {
+                continue;
+            }
+
+            Block block{start, start, 0, {}};
+            uint16_t pc = start;
+            auto terminated = false;
+
+            while (!terminated && block.length < kMaxBlockLength && pc + 1 < romEnd)
+            {
+                const uint16_t opcode = memory[pc] << 8 | memory[pc + 1];
+                const auto op = predecode(opcode);
+                const uint16_t next = pc + 2;
+
+                // Unknown opcodes are most likely data and FX0A modifies the instruction pointer
+                if (op.type == Opcode::Invalid || op.type == Opcode::CPU_FX0A)
+                {
+                    if (op.type == Opcode::CPU_FX0A)
+                    {
+                        enqueue(next);
+                    }
+                    break;
+                }
+
+                block.lines.push_back(translate(op, opcode, next));
+                block.length++;
+                pc = next;
+
+                switch (op.type) {
+                case Opcode::CPU_1NNN:
+                    enqueue(op.nnn);
+                    break;
+                case Opcode::CPU_2NNN:
+                    enqueue(op.nnn);
+                    enqueue(next);
+                    break;
+                case Opcode::CPU_3XNN:
+                case Opcode::CPU_4XNN:
+                case Opcode::CPU_5XY0:
+                case Opcode::CPU_9XY0:
+                case Opcode::CPU_EX9E:
+                case Opcode::CPU_EXA1:
+                    enqueue(next);
+                    enqueue(next + 2);
+                    break;
+                default:
+                    break;
+                }
+
+                terminated = isTerminator(op.type);
+
+                // Memory writes may modify the following code, so the block has to end here
+                if (op.type == Opcode::CPU_FX33 || op.type == Opcode::CPU_FX55)
+                {
+                    break;
+                }
+            }
+
+            if (block.length == 0)
+            {
+                continue;
+            }
+
+            // Blocks without a control flow instruction at the end continue behind it
+            if (!terminated)
+            {
+                block.lines.push_back("return " + hex(pc) + ";");
+                enqueue(pc);
+            }
+
+            block.end = pc;
+            blocks.emplace(start, std::move(block));
+        }
+
+        std::vector<Block> result;
+        for (auto &[start, block] : blocks)
+        {
+            result.push_back(std::move(block));
+        }
+        return result;
+    }
+
+    void writeModule(std::ostream &out, const std::string &name, const std::vector<uint8_t> &rom,
+                     const std::vector<Block> &blocks)
+    {
+        out << "// Generated by chip8_aot from " << name << " -- do not edit\n\n"
+            << "#include \"chip8/Aot.hpp\"\n"
+            << "#include \"chip8/Chip8.hpp\"\n\n"
+            << "namespace\n{\n";
+
+        // The original game is needed to identify it when it gets loaded
+        out << "    const uint8_t kRom[] = {";
+        for (size_t i = 0; i < rom.size(); i++)
+        {
+            out << ((i % 16 == 0) ? "\n        " : " ") << static_cast<int>(rom[i]) << ",";
+        }
+        out << "};\n\n";
+
+        for (const auto &block : blocks)
+        {
+            out << "    uint16_t block_" << hex(block.start)
+                << "([[maybe_unused]] Chip8State &s, [[maybe_unused]] const AotContext &c)\n"
+                << "    {\n";
+            for (const auto &line : block.lines)
+            {
+                out << "        " << line << "\n";
+            }
+            out << "    }\n\n";
+        }
+
+        out << "    const AotBlock kBlocks[] = {\n";
+        for (const auto &block : blocks)
+        {
+            out << "        {" << hex(block.start) << ", " << hex(block.end) << ", " << block.length
+                << ", block_" << hex(block.start) << "},\n";
+        }
+        out << "    };\n\n"
+            << "    const AotModule kModule{\"" << name << "\", kRom, sizeof(kRom), kBlocks, "
+            << "sizeof(kBlocks) / sizeof(kBlocks[0])};\n"
+            << "    const AotRegistrar kRegistrar{kModule};\n"
+            << "}\n";
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3)
+    {
+        std::cout << "Usage: chip8_aot <game.ch8> <output.cpp>" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const std::filesystem::path gamePath(argv[1]);
+    std::ifstream gameStream(gamePath, std::ios::in | std::ios::binary);
+    if (!gameStream)
+    {
+        std::cout << "Error: Couldn't open game file" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::vector<uint8_t> rom((std::istreambuf_iterator<char>(gameStream)), std::istreambuf_iterator<char>());
+    if (rom.empty() || rom.size() > 4096 - kStartAddress)
+    {
+        std::cout << "Error: Game file is empty or to big" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // Place the game in a memory image, so addresses can be used directly
+    std::vector<uint8_t> memory(4096, 0);
+    std::copy(rom.begin(), rom.end(), memory.begin() + kStartAddress);
+
+    const auto romEnd = static_cast<uint16_t>(kStartAddress + rom.size());
+    const auto blocks = discoverBlocks(memory, romEnd);
+
+    std::ofstream out(argv[2]);
+    if (!out)
+    {
+        std::cout << "Error: Couldn't open output file" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    writeModule(out, gamePath.filename().string(), rom, blocks);
+    std::cout << "Info: Compiled " << blocks.size() << " blocks of " << gamePath.filename().string() << std::endl;
+
+    return EXIT_SUCCESS;
+}
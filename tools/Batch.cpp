@@ -0,0 +1,300 @@
+//--------------------------------------------------------------------------------------------------
+// Cross-Platform Chip-8 Emulator
+// Copyright (C) 2020 Enrico Schörnick
+// Licensed under the MIT License
+//--------------------------------------------------------------------------------------------------
+
+/**
+ * chip8_batch: Runs every combination of games, decoders, speeds and inputs
+ * in parallel and prints one CSV line per run plus a summary. Directories
+ * are expanded to all .ch8 files in them. Every entry of --keys creates an
+ * input variant which presses and releases that key every 10 frames, "-"
+ * stands for no input at all, --seeds sets the random number generators.
+ * With --lockstep runs of the same game share SIMD lockstep engines instead
+ * of using the decoders, so --decoders is rejected there. --state starts
+ * every run from a save state.
+ *
+ * Usage: chip8_batch <game.ch8|directory>... [--frames N] [--threads N] [--lockstep]
+ *                    [--decoders LIST] [--speeds LIST] [--keys LIST] [--seeds LIST] [--state FILE]
+ */
+
+#include "chip8/SaveState.hpp"
+#include "chip8/BatchRunner.hpp"
+
+#include <cerrno>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <climits>
+#include <cstdlib>
+#include <sstream>
+#include <iomanip>
+#include <iostream>
+#include <algorithm>
+#include <filesystem>
+
+namespace
+{
+    const uint64_t kKeyPeriod{10};
+
+    void printUsage()
+    {
+        std::cout << "Usage: chip8_batch <game.ch8|directory>... [--frames N] [--threads N] [--lockstep]\n"
+                  << "                   [--decoders LIST] [--speeds LIST] [--keys LIST] [--seeds LIST] [--state FILE]"
+                  << std::endl;
+    }
+
+    std::vector<std::string> split(const std::string &list)
+    {
+        std::vector<std::string> items;
+        std::stringstream stream(list);
+        std::string item;
+        while (std::getline(stream, item, ','))
+        {
+            items.push_back(item);
+        }
+        return items;
+    }
+
+    // Parse a whole string as number, trailing garbage and overflows are rejected
+    bool parseNumber(const std::string &text, int base, long long &value)
+    {
+        if (text.empty())
+        {
+            return false;
+        }
+
+        char *end = nullptr;
+        errno = 0;
+        value = std::strtoll(text.c_str(), &end, base);
+        return errno == 0 && *end == '\0';
+    }
+
+    bool parseNumber(const std::string &text, long long minimum, long long maximum, long long &value)
+    {
+        return parseNumber(text, 10, value) && value >= minimum && value <= maximum;
+    }
+
+    // Press and release a key every kKeyPeriod frames
+    bool createInput(const std::string &key, uint64_t frames, std::vector<BatchInput> &inputs)
+    {
+        inputs.clear();
+        if (key == "-")
+        {
+            return true;
+        }
+
+        long long index;
+        if (!parseNumber(key, 16, index) || index < 0 || index > 0xF)
+        {
+            return false;
+        }
+
+        const uint16_t mask = 1 << index;
+        for (uint64_t frame = 0; frame < frames; frame += kKeyPeriod)
+        {
+            inputs.push_back(BatchInput{frame, static_cast<uint16_t>(((frame / kKeyPeriod) % 2 == 0) ? mask : 0)});
+        }
+        return true;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<std::string> games;
+    std::vector<Decoder> decoders;
+    std::vector<int> speeds{0};
+    std::vector<std::string> keys{"-"};
+    std::vector<uint32_t> seeds{1};
+    uint64_t frames = 600;
+    unsigned threads = 0;
+    bool lockstep = false;
+    std::shared_ptr<const MachineState> startState;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string argument(argv[i]);
+        if (argument.rfind("--", 0) != 0)
+        {
+            games.push_back(argument);
+            continue;
+        }
+
+        if (argument == "--lockstep")
+        {
+            lockstep = true;
+            continue;
+        }
+
+        if (i + 1 >= argc)
+        {
+            printUsage();
+            return EXIT_FAILURE;
+        }
+
+        const std::string value(argv[++i]);
+        long long number;
+        if (argument == "--frames")
+        {
+            if (!parseNumber(value, 0, LLONG_MAX, number))
+            {
+                printUsage();
+                return EXIT_FAILURE;
+            }
+            frames = number;
+        }
+        else if (argument == "--threads")
+        {
+            if (!parseNumber(value, 0, UINT_MAX, number))
+            {
+                printUsage();
+                return EXIT_FAILURE;
+            }
+            threads = number;
+        }
+        else if (argument == "--decoders")
+        {
+            for (const auto &name : split(value))
+            {
+                Decoder decoder;
+                if (!parseDecoder(name, decoder))
+                {
+                    return EXIT_FAILURE;
+                }
+                decoders.push_back(decoder);
+            }
+        }
+        else if (argument == "--speeds")
+        {
+            speeds.clear();
+            for (const auto &speed : split(value))
+            {
+                if (!parseNumber(speed, 0, INT_MAX, number))
+                {
+                    printUsage();
+                    return EXIT_FAILURE;
+                }
+                speeds.push_back(number);
+            }
+        }
+        else if (argument == "--keys")
+        {
+            keys = split(value);
+        }
+        else if (argument == "--state")
+        {
+            SaveStateFile stateFile;
+            if (!stateFile.open(value))
+            {
+                return EXIT_FAILURE;
+            }
+            startState = std::make_shared<const MachineState>(*stateFile.getState());
+        }
+        else if (argument == "--seeds")
+        {
+            seeds.clear();
+            for (const auto &seed : split(value))
+            {
+                if (!parseNumber(seed, 0, UINT32_MAX, number))
+                {
+                    printUsage();
+                    return EXIT_FAILURE;
+                }
+                seeds.push_back(number);
+            }
+        }
+        else
+        {
+            printUsage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Key presses are created once per key and shared by all runs using them
+    std::vector<std::vector<BatchInput>> inputs(keys.size());
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        if (!createInput(keys[i], frames, inputs[i]))
+        {
+            printUsage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Lockstep engines ignore the decoder, several of them would only produce identical runs
+    if (lockstep && !decoders.empty())
+    {
+        std::cout << "Error: --decoders can't be combined with --lockstep" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (decoders.empty())
+    {
+        decoders.push_back(Decoder::Cached);
+    }
+
+    const auto gamePaths = findGames(games);
+
+    if (gamePaths.empty())
+    {
+        printUsage();
+        return EXIT_FAILURE;
+    }
+
+    std::vector<BatchJob> jobs;
+    for (const auto &gamePath : gamePaths)
+    {
+        for (auto decoder : decoders)
+        {
+            for (auto speed : speeds)
+            {
+                for (const auto &input : inputs)
+                {
+                    for (auto seed : seeds)
+                    {
+                        jobs.push_back(BatchJob{gamePath, decoder, frames, speed, input, seed, startState});
+                    }
+                }
+            }
+        }
+    }
+
+    using namespace std::chrono;
+    BatchRunner runner(threads);
+    runner.setLockstep(lockstep);
+    const auto startTime = steady_clock::now();
+    const auto results = runner.run(jobs);
+    const auto elapsed = duration<double>(steady_clock::now() - startTime).count();
+
+    std::cout << "game,decoder,speed,keys,seed,loaded,instructions,ms,display,frames,pc,i" << std::endl;
+    uint64_t instructions = 0;
+    for (size_t i = 0; i < jobs.size(); i++)
+    {
+        const auto &job = jobs[i];
+        const auto &result = results[i];
+        instructions += result.instructions;
+
+        std::cout << std::filesystem::path(job.gamePath).filename().string() << ","
+                  << (lockstep ? "lockstep" : getDecoderName(job.decoder)) << "," << job.instructionsPerSecond << ","
+                  << keys[(i / seeds.size()) % keys.size()] << "," << job.seed << "," << result.loaded << "," << result.instructions << ","
+                  << std::fixed << std::setprecision(3) << result.seconds * 1000.0 << ","
+                  << std::hex << std::uppercase << std::setfill('0')
+                  << std::setw(16) << result.displayHash << "," << std::setw(16) << result.framesHash << ","
+                  << std::setw(3) << result.instructionPointer << "," << std::setw(3) << result.I
+                  << std::dec << std::nouppercase << std::setfill(' ') << std::endl;
+    }
+
+    uint64_t steals = 0;
+    for (const auto &stats : runner.getStats())
+    {
+        steals += stats.steals;
+    }
+
+    std::cout << "Info: " << jobs.size() << " runs with " << instructions << " instructions on "
+              << runner.getThreads() << " threads in " << std::setprecision(3) << elapsed * 1000.0 << " ms ("
+              << std::setprecision(1) << ((elapsed > 0.0) ? instructions / elapsed / 1000000.0 : 0.0)
+              << " MIPS, " << steals << " steals)" << std::endl;
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,400 @@
+//--------------------------------------------------------------------------------------------------
+// Cross-Platform Chip-8 Emulator
+// Copyright (C) 2020 Enrico Schörnick
+// Licensed under the MIT License
+//--------------------------------------------------------------------------------------------------
+
+/**
+ * chip8_bench: Runs every game of a directory (data/games by default) for a
+ * fixed number of 60Hz frames on one thread, with a fixed random seed and a
+ * scripted input which presses and releases the keys 0-F in turn, one every
+ * 10 frames. Every game runs once for warm up and then --repetitions times,
+ * loading the game is not measured. Prints instructions per second, ns per
+ * instruction and frames per second of every game with their standard
+ * deviation, --output stores them as JSON. --compare reads the JSON of an
+ * earlier run and marks every game which got faster or slower by more than
+ * --threshold percent and more than twice the noise of both runs, any slower
+ * game makes the benchmark fail.
+ *
+ * Usage: chip8_bench [game.ch8|directory]... [--frames N] [--repetitions N] [--decoder NAME]
+ *                    [--seed N] [--output FILE] [--compare FILE] [--threshold PERCENT]
+ */
+
+#include "chip8/Chip8.hpp"
+
+#include <map>
+#include <cmath>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <algorithm>
+#include <filesystem>
+
+namespace
+{
+    const char *kDefaultGames{"data/games"};
+    const uint64_t kKeyPeriod{10};
+
+    void printUsage()
+    {
+        std::cout << "Usage: chip8_bench [game.ch8|directory]... [--frames N] [--repetitions N] [--decoder NAME]\n"
+                  << "                   [--seed N] [--output FILE] [--compare FILE] [--threshold PERCENT]"
+                  << std::endl;
+    }
+
+    // Mean and sample standard deviation
+    struct Statistic
+    {
+        double mean{0.0};
+        double deviation{0.0};
+
+        explicit Statistic(const std::vector<double> &values)
+        {
+            for (const auto value : values)
+            {
+                mean += value;
+            }
+            mean /= values.size();
+
+            for (const auto value : values)
+            {
+                deviation += (value - mean) * (value - mean);
+            }
+            deviation = (values.size() > 1) ? std::sqrt(deviation / (values.size() - 1)) : 0.0;
+        }
+
+        double getRelativeDeviation() const
+        {
+            return (mean > 0.0) ? deviation / mean : 0.0;
+        }
+    };
+
+    struct Run
+    {
+        uint64_t instructions{0};
+        uint64_t frames{0};
+        uint64_t displayHash{0};
+        double seconds{0.0};
+    };
+
+    struct GameResult
+    {
+        std::string game;
+        uint64_t instructions{0};
+        uint64_t frames{0};
+        Statistic instructionsPerSecond;
+        Statistic nsPerInstruction;
+        Statistic framesPerSecond;
+    };
+
+    // Result of an earlier benchmark, read back from its JSON
+    struct Baseline
+    {
+        double instructionsPerSecond{0.0};
+        double deviation{0.0};
+    };
+
+    bool runGame(Chip8 &chip8, const std::string &gamePath, uint32_t seed, uint64_t frames, Run &run)
+    {
+        // Loading restarts the frame timing as well, so every run executes exactly the same instructions
+        if (!chip8.loadGame(gamePath))
+        {
+            return false;
+        }
+        chip8.setSeed(seed);
+        chip8.start();
+
+        using namespace std::chrono;
+        const auto &state = chip8.getState();
+        const auto startTime = steady_clock::now();
+
+        for (run.frames = 0; run.frames < frames && state.isRunning; run.frames++)
+        {
+            if (run.frames % kKeyPeriod == 0)
+            {
+                const auto period = run.frames / kKeyPeriod;
+                chip8.setButton(period % 2 == 0, (period / 2) % 16);
+            }
+            run.instructions += chip8.runFrame();
+        }
+
+        run.seconds = duration<double>(steady_clock::now() - startTime).count();
+        run.displayHash = state.getDisplayHash();
+        return true;
+    }
+
+    double findNumber(const std::string &text, const std::string &key)
+    {
+        const auto position = text.find("\"" + key + "\": ");
+        if (position == std::string::npos)
+        {
+            return 0.0;
+        }
+        return std::strtod(text.c_str() + position + key.size() + 4, nullptr);
+    }
+
+    // Only reads the JSON written by chip8_bench itself, one game per line
+    bool loadBaseline(const std::string &path, std::map<std::string, Baseline> &baseline)
+    {
+        std::ifstream file(path);
+        if (!file.is_open())
+        {
+            std::cout << "Error: Couldn't open " << path << std::endl;
+            return false;
+        }
+
+        const std::string kGameKey{"{\"game\": \""};
+        std::string line;
+        while (std::getline(file, line))
+        {
+            const auto position = line.find(kGameKey);
+            if (position == std::string::npos)
+            {
+                continue;
+            }
+
+            const auto nameStart = position + kGameKey.size();
+            const auto name = line.substr(nameStart, line.find('"', nameStart) - nameStart);
+            baseline[name] = Baseline{findNumber(line, "instructionsPerSecond"),
+                                      findNumber(line, "instructionsPerSecondDeviation")};
+        }
+
+        if (baseline.empty())
+        {
+            std::cout << "Error: " << path << " contains no benchmark results" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    bool saveResults(const std::string &path, const std::vector<GameResult> &results, uint64_t frames,
+                     int repetitions, Decoder decoder, uint32_t seed)
+    {
+        std::ofstream file(path);
+        if (!file.is_open())
+        {
+            std::cout << "Error: Couldn't open " << path << std::endl;
+            return false;
+        }
+
+        file << std::fixed << std::setprecision(3) << "{\n  \"frames\": " << frames << ",\n  \"repetitions\": "
+             << repetitions << ",\n  \"decoder\": \"" << getDecoderName(decoder) << "\",\n  \"seed\": " << seed
+             << ",\n  \"games\": [\n";
+
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            const auto &result = results[i];
+            file << "    {\"game\": \"" << result.game << "\", \"instructions\": " << result.instructions
+                 << ", \"frames\": " << result.frames
+                 << ", \"instructionsPerSecond\": " << result.instructionsPerSecond.mean
+                 << ", \"instructionsPerSecondDeviation\": " << result.instructionsPerSecond.deviation
+                 << ", \"nsPerInstruction\": " << result.nsPerInstruction.mean
+                 << ", \"nsPerInstructionDeviation\": " << result.nsPerInstruction.deviation
+                 << ", \"framesPerSecond\": " << result.framesPerSecond.mean
+                 << ", \"framesPerSecondDeviation\": " << result.framesPerSecond.deviation << "}"
+                 << ((i + 1 < results.size()) ? ",\n" : "\n");
+        }
+        file << "  ]\n}\n";
+
+        if (!file)
+        {
+            std::cout << "Error: Couldn't write " << path << std::endl;
+            return false;
+        }
+
+        std::cout << "Info: Results saved to " << path << std::endl;
+        return true;
+    }
+
+    // Returns the number of games which got slower
+    int compareResults(const std::vector<GameResult> &results, const std::map<std::string, Baseline> &baseline,
+                       double threshold)
+    {
+        std::cout << "\n" << std::left << std::setw(24) << "Game" << std::right << std::setw(12) << "Old MIPS"
+                  << std::setw(12) << "New MIPS" << std::setw(10) << "Change" << "  Verdict" << std::endl;
+
+        int slower = 0;
+        for (const auto &result : results)
+        {
+            const auto old = baseline.find(result.game);
+            if (old == baseline.end() || old->second.instructionsPerSecond <= 0.0)
+            {
+                std::cout << std::left << std::setw(24) << result.game << std::right << "  not in baseline" << std::endl;
+                continue;
+            }
+
+            const auto &before = old->second;
+            const auto change = result.instructionsPerSecond.mean / before.instructionsPerSecond - 1.0;
+
+            // A change only counts if it's larger than the noise of both runs
+            const auto noise = 2.0 * (before.deviation / before.instructionsPerSecond +
+                                      result.instructionsPerSecond.getRelativeDeviation());
+            const auto significant = std::abs(change) > std::max(threshold / 100.0, noise);
+            slower += (significant && change < 0.0);
+
+            std::cout << std::left << std::setw(24) << result.game << std::right << std::fixed << std::setprecision(2)
+                      << std::setw(12) << before.instructionsPerSecond / 1000000.0 << std::setw(12)
+                      << result.instructionsPerSecond.mean / 1000000.0 << std::setw(9) << std::showpos
+                      << change * 100.0 << std::noshowpos << "%  "
+                      << (!significant ? "same" : (change < 0.0) ? "slower" : "faster") << std::endl;
+        }
+        return slower;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<std::string> games;
+    uint64_t frames = 180000;
+    int repetitions = 5;
+    Decoder decoder = Decoder::Cached;
+    uint32_t seed = 1;
+    double threshold = 5.0;
+    std::string outputPath;
+    std::string comparePath;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string argument(argv[i]);
+        if (argument.rfind("--", 0) != 0)
+        {
+            games.push_back(argument);
+            continue;
+        }
+
+        if (i + 1 >= argc)
+        {
+            printUsage();
+            return EXIT_FAILURE;
+        }
+
+        const std::string value(argv[++i]);
+        if (argument == "--frames")
+        {
+            frames = std::strtoull(value.c_str(), nullptr, 10);
+        }
+        else if (argument == "--repetitions")
+        {
+            repetitions = std::max(1, std::atoi(value.c_str()));
+        }
+        else if (argument == "--decoder")
+        {
+            if (!parseDecoder(value, decoder))
+            {
+                return EXIT_FAILURE;
+            }
+        }
+        else if (argument == "--seed")
+        {
+            seed = std::strtoul(value.c_str(), nullptr, 10);
+        }
+        else if (argument == "--output")
+        {
+            outputPath = value;
+        }
+        else if (argument == "--compare")
+        {
+            comparePath = value;
+        }
+        else if (argument == "--threshold")
+        {
+            threshold = std::strtod(value.c_str(), nullptr);
+        }
+        else
+        {
+            printUsage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (games.empty())
+    {
+        games.push_back(kDefaultGames);
+    }
+
+    const auto gamePaths = findGames(games);
+
+    if (gamePaths.empty())
+    {
+        printUsage();
+        return EXIT_FAILURE;
+    }
+
+    // Read the baseline first, so a typo doesn't waste a whole benchmark run
+    std::map<std::string, Baseline> baseline;
+    if (!comparePath.empty() && !loadBaseline(comparePath, baseline))
+    {
+        return EXIT_FAILURE;
+    }
+
+    Chip8 chip8;
+    chip8.setDecoder(decoder);
+
+    std::cout << std::left << std::setw(24) << "Game" << std::right << std::setw(14) << "Instructions"
+              << std::setw(10) << "MIPS" << std::setw(8) << "+-%" << std::setw(12) << "ns/instr"
+              << std::setw(12) << "Frames/s" << std::endl;
+
+    std::vector<GameResult> results;
+    for (const auto &gamePath : gamePaths)
+    {
+        const auto game = std::filesystem::path(gamePath).filename().string();
+
+        // The first run only warms up caches, predecoded instructions and compiled blocks
+        Run warmUp;
+        if (!runGame(chip8, gamePath, seed, frames, warmUp))
+        {
+            return EXIT_FAILURE;
+        }
+
+        std::vector<double> instructionsPerSecond;
+        std::vector<double> nsPerInstruction;
+        std::vector<double> framesPerSecond;
+        for (int repetition = 0; repetition < repetitions; repetition++)
+        {
+            Run run;
+            if (!runGame(chip8, gamePath, seed, frames, run))
+            {
+                return EXIT_FAILURE;
+            }
+            if (run.instructions != warmUp.instructions || run.displayHash != warmUp.displayHash)
+            {
+                std::cout << "Error: " << game << " doesn't run the same way every time" << std::endl;
+                return EXIT_FAILURE;
+            }
+
+            // Timer resolution is the limit, runs which are too short to measure count as 1 ns
+            const auto seconds = std::max(run.seconds, 1e-9);
+            instructionsPerSecond.push_back(run.instructions / seconds);
+            nsPerInstruction.push_back((run.instructions > 0) ? seconds * 1e9 / run.instructions : 0.0);
+            framesPerSecond.push_back(run.frames / seconds);
+        }
+
+        results.push_back(GameResult{game, warmUp.instructions, warmUp.frames, Statistic(instructionsPerSecond),
+                                     Statistic(nsPerInstruction), Statistic(framesPerSecond)});
+
+        const auto &result = results.back();
+        std::cout << std::left << std::setw(24) << game << std::right << std::setw(14) << result.instructions
+                  << std::fixed << std::setprecision(2) << std::setw(10)
+                  << result.instructionsPerSecond.mean / 1000000.0 << std::setw(8) << std::setprecision(1)
+                  << result.instructionsPerSecond.getRelativeDeviation() * 100.0 << std::setw(12)
+                  << std::setprecision(2) << result.nsPerInstruction.mean << std::setw(12) << std::setprecision(0)
+                  << result.framesPerSecond.mean << std::endl;
+    }
+
+    if (!outputPath.empty() && !saveResults(outputPath, results, frames, repetitions, decoder, seed))
+    {
+        return EXIT_FAILURE;
+    }
+
+    if (!comparePath.empty() && compareResults(results, baseline, threshold) > 0)
+    {
+        std::cout << "Error: Some games got slower than in " << comparePath << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,274 @@
+//--------------------------------------------------------------------------------------------------
+// Cross-Platform Chip-8 Emulator
+// Copyright (C) 2020 Enrico Schörnick
+// Licensed under the MIT License
+//--------------------------------------------------------------------------------------------------
+
+/**
+ * chip8_disasm: Disassembles games in parallel, directories are expanded to
+ * all .ch8 files in them. Every worker thread formats the listing of a game
+ * into its own arena which is written in one piece, either to stdout (in the
+ * order of the games) or with --output into one <game>.txt per game.
+ * Listings follow the control flow of the game: bytes which are never
+ * executed show up as data (DB) and subroutines start with an empty line and
+ * ':' behind their address. --verify prints the subroutines, code size and
+ * issues (invalid opcodes, targets outside of the game) of every game instead
+ * of the listing, any issue but an indirect jump makes it fail. --dot writes
+ * the control flow graph of every game as <game>.dot.
+ *
+ * Usage: chip8_disasm <game.ch8|directory>... [--output DIRECTORY] [--verify] [--dot DIRECTORY] [--threads N]
+ */
+
+#include "chip8/Chip8.hpp"
+#include "chip8/Disassembler.hpp"
+#include "chip8/ControlFlowGraph.hpp"
+
+#include <array>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <filesystem>
+
+namespace
+{
+    const uint16_t kStartAddress{0x200};
+
+    void printUsage()
+    {
+        std::cout << "Usage: chip8_disasm <game.ch8|directory>... [--output DIRECTORY] [--verify] [--dot DIRECTORY]\n"
+                  << "                    [--threads N]" << std::endl;
+    }
+
+    // Returns the end address of the game, 0 if it couldn't be read
+    uint16_t loadGame(const std::string &gamePath, std::array<uint8_t, 4096> &memory)
+    {
+        memory.fill(0);
+        std::ifstream file(gamePath, std::ios::binary);
+        file.read(reinterpret_cast<char *>(memory.data()) + kStartAddress, memory.size() - kStartAddress);
+        if (file.bad() || file.gcount() == 0)
+        {
+            return 0;
+        }
+        return kStartAddress + file.gcount();
+    }
+
+    // One line per instruction or data word of the game, data in front of misaligned code gets a line per byte
+    void disassembleGame(const std::array<uint8_t, 4096> &memory, uint16_t end, const ControlFlowGraph &graph,
+                         std::vector<char> &arena)
+    {
+        arena.clear();
+        for (int address = kStartAddress; address < end;)
+        {
+            const auto role = graph.getRole(address);
+            if (role == Disassembler::Role::Subroutine && address != kStartAddress)
+            {
+                arena.push_back('\n');
+            }
+
+            const auto size = arena.size();
+            arena.resize(size + Disassembler::kLineSize + 1);
+
+            const uint16_t opcode = memory[address] << 8 | memory[(address + 1) & 0xFFF];
+            const auto length = Disassembler::format(arena.data() + size, address, opcode, role);
+            arena[size + length] = '\n';
+            arena.resize(size + length + 1);
+
+            address += (role == Disassembler::Role::Byte) ? 1 : 2;
+        }
+    }
+
+    std::string verifyGame(const std::string &name, const ControlFlowGraph &graph, uint16_t end)
+    {
+        const auto &issues = graph.getIssues();
+        const auto errors = std::count_if(issues.begin(), issues.end(),
+                                          [](const auto &issue) { return issue.isError(); });
+
+        std::stringstream report;
+        report << name << ": " << graph.getBlocks().size() << " blocks in " << graph.getFunctions().size()
+               << " subroutines, " << graph.getCodeSize() << " of " << (end - kStartAddress) << " bytes code, "
+               << errors << " errors, " << (issues.size() - errors) << " warnings\n";
+
+        for (const auto &issue : issues)
+        {
+            report << "  " << std::hex << issue.address << std::dec << ": "
+                   << (issue.isError() ? "error: " : "warning: ") << ControlFlowGraph::getIssueName(issue.type) << "\n";
+        }
+        return report.str();
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<std::string> games;
+    std::string outputPath;
+    std::string dotPath;
+    bool verify = false;
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string argument(argv[i]);
+        if (argument.rfind("--", 0) != 0)
+        {
+            games.push_back(argument);
+            continue;
+        }
+
+        if (argument == "--verify")
+        {
+            verify = true;
+            continue;
+        }
+
+        if (i + 1 >= argc)
+        {
+            printUsage();
+            return EXIT_FAILURE;
+        }
+
+        const std::string value(argv[++i]);
+        if (argument == "--output")
+        {
+            outputPath = value;
+        }
+        else if (argument == "--dot")
+        {
+            dotPath = value;
+        }
+        else if (argument == "--threads")
+        {
+            threads = std::max(1ul, std::strtoul(value.c_str(), nullptr, 10));
+        }
+        else
+        {
+            printUsage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    const auto gamePaths = findGames(games);
+
+    if (gamePaths.empty())
+    {
+        printUsage();
+        return EXIT_FAILURE;
+    }
+
+    for (const auto &directory : {outputPath, dotPath})
+    {
+        if (!directory.empty() && !std::filesystem::is_directory(directory))
+        {
+            std::cout << "Error: Output directory " << directory << " doesn't exist" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Listings and reports for stdout have to wait for their turn, files get written right away
+    const auto printListings = outputPath.empty() && dotPath.empty() && !verify;
+    std::vector<std::vector<char>> listings(printListings ? gamePaths.size() : 0);
+    std::vector<std::string> reports(gamePaths.size());
+    std::vector<char> failed(gamePaths.size(), false);
+    std::vector<char> hasErrors(gamePaths.size(), false);
+    std::atomic<size_t> next{0};
+
+    auto work = [&]() {
+        std::array<uint8_t, 4096> memory;
+        std::vector<char> arena;
+        arena.reserve((4096 - kStartAddress) / 2 * (Disassembler::kLineSize + 1));
+
+        for (auto game = next++; game < gamePaths.size(); game = next++)
+        {
+            const std::filesystem::path gamePath(gamePaths[game]);
+            const auto end = loadGame(gamePaths[game], memory);
+            if (end == 0)
+            {
+                failed[game] = true;
+                continue;
+            }
+
+            // Listings need the graph as well to tell code from data
+            ControlFlowGraph graph;
+            graph.build(memory, kStartAddress, end);
+
+            if (printListings || !outputPath.empty())
+            {
+                auto &listing = printListings ? listings[game] : arena;
+                disassembleGame(memory, end, graph, listing);
+
+                if (!outputPath.empty())
+                {
+                    std::ofstream file(std::filesystem::path(outputPath) / (gamePath.stem().string() + ".txt"),
+                                       std::ios::binary);
+                    file.write(listing.data(), listing.size());
+                    failed[game] = !file;
+                }
+            }
+
+            if (verify || !dotPath.empty())
+            {
+                const auto &issues = graph.getIssues();
+                hasErrors[game] = std::any_of(issues.begin(), issues.end(),
+                                              [](const auto &issue) { return issue.isError(); });
+
+                if (verify)
+                {
+                    reports[game] = verifyGame(gamePath.filename().string(), graph, end);
+                }
+
+                const auto dotFile = std::filesystem::path(dotPath) / (gamePath.stem().string() + ".dot");
+                if (!dotPath.empty() && !graph.saveDot(dotFile.string(), gamePath.filename().string()))
+                {
+                    failed[game] = true;
+                }
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned i = 0; i < std::min<size_t>(threads, gamePaths.size()); i++)
+    {
+        workers.emplace_back(work);
+    }
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+
+    auto result = EXIT_SUCCESS;
+    for (size_t game = 0; game < gamePaths.size(); game++)
+    {
+        if (failed[game])
+        {
+            std::cout << "Error: Couldn't disassemble " << gamePaths[game] << std::endl;
+            result = EXIT_FAILURE;
+        }
+        else if (printListings)
+        {
+            std::cout << "; " << std::filesystem::path(gamePaths[game]).filename().string() << "\n";
+            std::cout.write(listings[game].data(), listings[game].size());
+        }
+        else if (verify)
+        {
+            std::cout << reports[game];
+            result = hasErrors[game] ? EXIT_FAILURE : result;
+        }
+    }
+
+    if (!outputPath.empty())
+    {
+        std::cout << "Info: " << gamePaths.size() << " games disassembled to " << outputPath << std::endl;
+    }
+
+    if (!dotPath.empty())
+    {
+        std::cout << "Info: Control flow graphs written to " << dotPath << std::endl;
+    }
+
+    return result;
+}
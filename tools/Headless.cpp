@@ -0,0 +1,244 @@
+//--------------------------------------------------------------------------------------------------
+// Cross-Platform Chip-8 Emulator
+// Copyright (C) 2020 Enrico Schörnick
+// Licensed under the MIT License
+//--------------------------------------------------------------------------------------------------
+
+/**
+ * chip8_headless: Runs a game without any user interface at maximum speed and
+ * prints the timing, the final registers and a hash of the framebuffer. Frames
+ * execute the instructions of 1/60 s at the game's speed and tick the timers.
+ * The run can start from a save state and store its final state in one.
+ * --record stores the run as input movie, --movie replays one instead.
+ * --profile writes the opcode profile (JSON, or CSV for *.csv), --hotspots
+ * the addresses sorted by time spent and --coverage which instructions ran,
+ * these need a build with CHIP8_PROFILE.
+ *
+ * Usage: chip8_headless <game.ch8> [--instructions N | --frames N | --movie FILE] [--decoder NAME]
+ *                       [--seed N] [--load-state FILE] [--save-state FILE] [--record FILE]
+ *                       [--profile FILE] [--hotspots FILE] [--coverage FILE]
+ */
+
+#include "chip8/Chip8.hpp"
+#include "chip8/Profiler.hpp"
+#include "chip8/InputMovie.hpp"
+
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+
+namespace
+{
+    const uint64_t kDefaultInstructions{1000000};
+
+    void printUsage()
+    {
+        std::cout << "Usage: chip8_headless <game.ch8> [--instructions N | --frames N | --movie FILE] [--decoder NAME]\n"
+                  << "                      [--seed N] [--load-state FILE] [--save-state FILE] [--record FILE]\n"
+                  << "                      [--profile FILE] [--hotspots FILE] [--coverage FILE]" << std::endl;
+    }
+
+    void printState(const Chip8State &state)
+    {
+        std::cout << std::hex << std::uppercase << std::setfill('0')
+                  << "PC: 0x" << std::setw(3) << state.instructionPointer
+                  << "  I: 0x" << std::setw(3) << state.I
+                  << "  SP: 0x" << std::setw(1) << static_cast<int>(state.stackPointer)
+                  << "  DT: 0x" << std::setw(2) << static_cast<int>(state.delayTimer)
+                  << "  ST: 0x" << std::setw(2) << static_cast<int>(state.soundTimer) << std::endl;
+
+        for (int i = 0; i < 16; i++)
+        {
+            std::cout << "V" << i << ": 0x" << std::setw(2) << static_cast<int>(state.V[i])
+                      << ((i % 8 == 7) ? "\n" : "  ");
+        }
+
+        std::cout << "Framebuffer: 0x" << std::setw(16) << state.getDisplayHash() << std::dec << std::endl;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        printUsage();
+        return EXIT_FAILURE;
+    }
+
+    Chip8 chip8;
+    uint64_t instructions = kDefaultInstructions;
+    uint64_t frames = 0;
+    std::string loadStatePath;
+    std::string saveStatePath;
+    std::string moviePath;
+    std::string recordPath;
+    std::string profilePath;
+    std::string hotSpotPath;
+    std::string coveragePath;
+
+    for (int i = 2; i < argc; i++)
+    {
+        const std::string option(argv[i]);
+        if (i + 1 >= argc)
+        {
+            printUsage();
+            return EXIT_FAILURE;
+        }
+
+        const std::string value(argv[++i]);
+        if (option == "--instructions")
+        {
+            instructions = std::strtoull(value.c_str(), nullptr, 10);
+            frames = 0;
+        }
+        else if (option == "--frames")
+        {
+            frames = std::strtoull(value.c_str(), nullptr, 10);
+        }
+        else if (option == "--movie")
+        {
+            moviePath = value;
+        }
+        else if (option == "--record")
+        {
+            recordPath = value;
+        }
+        else if (option == "--profile")
+        {
+            profilePath = value;
+        }
+        else if (option == "--hotspots")
+        {
+            hotSpotPath = value;
+        }
+        else if (option == "--coverage")
+        {
+            coveragePath = value;
+        }
+        else if (option == "--seed")
+        {
+            chip8.setSeed(std::strtoul(value.c_str(), nullptr, 10));
+        }
+        else if (option == "--load-state")
+        {
+            loadStatePath = value;
+        }
+        else if (option == "--save-state")
+        {
+            saveStatePath = value;
+        }
+        else if (option == "--decoder")
+        {
+            Decoder decoder;
+            if (!parseDecoder(value, decoder))
+            {
+                return EXIT_FAILURE;
+            }
+            chip8.setDecoder(decoder);
+        }
+        else
+        {
+            printUsage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (!chip8.loadGame(argv[1]))
+    {
+        std::cout << "Error: Couldn't load game file" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (!loadStatePath.empty() && !chip8.loadStateFile(loadStatePath))
+    {
+        return EXIT_FAILURE;
+    }
+
+    InputMovie movie;
+    if (!moviePath.empty() && !movie.load(moviePath))
+    {
+        return EXIT_FAILURE;
+    }
+
+    const auto &state = chip8.getState();
+    if (!recordPath.empty())
+    {
+        movie.startRecording(state, state.game->name);
+        chip8.setMovie(&movie);
+    }
+
+    Profiler profiler;
+    if (!profilePath.empty() || !hotSpotPath.empty() || !coveragePath.empty())
+    {
+#ifdef CHIP8_PROFILE
+        chip8.setProfiler(&profiler);
+#else
+        std::cout << "Error: Profiling needs a build with -DCHIP8_PROFILE=ON" << std::endl;
+        return EXIT_FAILURE;
+#endif
+    }
+    chip8.start();
+
+    using namespace std::chrono;
+    const auto startTime = steady_clock::now();
+    uint64_t executed = 0;
+
+    if (!moviePath.empty())
+    {
+        // The movie brings its own start state
+        const auto startCount = movie.getStartState().instructionCount;
+        if (!movie.replay(chip8))
+        {
+            return EXIT_FAILURE;
+        }
+        executed = state.instructionCount - startCount;
+    }
+    else if (frames > 0)
+    {
+        for (uint64_t frame = 0; frame < frames && state.isRunning; frame++)
+        {
+            executed += chip8.runFrame();
+        }
+    }
+    else
+    {
+        executed = chip8.execute(instructions);
+    }
+
+    const auto elapsed = duration<double>(steady_clock::now() - startTime).count();
+
+    std::cout << "Info: Executed " << executed << " instructions in " << std::fixed << std::setprecision(3)
+              << elapsed * 1000.0 << " ms (" << std::setprecision(1)
+              << ((elapsed > 0.0) ? executed / elapsed / 1000000.0 : 0.0) << " MIPS)" << std::endl;
+    printState(state);
+
+    if (!saveStatePath.empty() && !chip8.saveStateFile(saveStatePath))
+    {
+        return EXIT_FAILURE;
+    }
+
+    if (!recordPath.empty() && !movie.save(recordPath))
+    {
+        return EXIT_FAILURE;
+    }
+
+    if (!profilePath.empty() && !profiler.save(profilePath))
+    {
+        return EXIT_FAILURE;
+    }
+
+    if (!hotSpotPath.empty() && !profiler.saveHotSpots(hotSpotPath, state))
+    {
+        return EXIT_FAILURE;
+    }
+
+    if (!coveragePath.empty() && !profiler.saveCoverage(coveragePath, state))
+    {
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}